@@ -0,0 +1,808 @@
+#include "bench.h"
+
+#include "efm32.h"
+#include "efm32_int.h"
+
+#include "scheduler.h"
+#include "swtimer.h"
+#include "ringbuf.h"
+#include "proto.h"
+#include "workq.h"
+#include "dwt.h"
+
+#define BENCH_WORKERS 		(MAX_TASKS - 5) // less idle, the suite and the timer, protothread and work queue tasks
+#define BENCH_FLAG 			0x80000000
+#define BENCH_ISR_WAKE 		0 // give isr_sem
+#define BENCH_ISR_INLINE 		1 // pend the probe, then do the work in the handler
+#define BENCH_ISR_DEFERRED 	2 // pend the probe, then post the work to the work queue
+#define BENCH_ISR_POST 		3 // post the work, sampling until it starts
+
+/* variables */
+static bench_result_t result;
+static volatile uint32_t stamp; // cycle count the next sample is taken against, 0 = none
+static volatile uint32_t running; // workers not finished yet
+static uint32_t rounds;
+static semaphore_t done;
+static semaphore_t isr_sem;
+static volatile uint32_t isr_mode; // what BENCH_Isr does, one of the BENCH_ISR_ values
+static volatile uint32_t probe_stamp; // cycle count the probe was pended at
+static swtimer_t timers[BENCH_TIMERS];
+static uint8_t ring_buffer[1024];
+static ringbuf_t ring;
+static proto_t protos[2];
+static uint32_t proto_rounds[2];
+static queue_t queues[2]; // ping and pong
+static void *queue_slots[2][1];
+
+static task_t workers[BENCH_WORKERS];
+static uint32_t worker_stacks[BENCH_WORKERS][BENCH_STACK_SIZE / 4] __attribute__((aligned(STACK_ALIGN)));
+
+/*
+ * Scheduler microbenchmarks. Every figure is in DWT cycles (on the host, time
+ * scaled to cycles of a SystemCoreClock core) and printed as one JSON object
+ * per line, so runs can be diffed or loaded by a script:
+ *
+ * {"bench":"switch","tasks":4,"samples":1000,"min":..,"mean":..,"max":..}
+ *
+ * Workers run below the suite's task and exit when done, freeing their slot
+ * for the next benchmark. Samples include whatever SysTick steals, which
+ * shows up in max rather than min or mean.
+ */
+
+/* prototypes */
+static void BENCH_Reset();
+static void BENCH_Sample(uint32_t cycles);
+static void BENCH_Report(const char *name, const char *param, uint32_t value);
+static void BENCH_Print(const char *text);
+static void BENCH_PrintNumber(uint64_t value);
+static bool BENCH_Spawn(void *entry_point, uint32_t priority);
+static void BENCH_Finish();
+static void BENCH_Wait();
+static void BENCH_Switch(uint32_t tasks);
+static void BENCH_SwitchTask();
+static void BENCH_Wakeup();
+static void BENCH_WakeupWaiter();
+static void BENCH_WakeupReleaser();
+static void BENCH_Queue();
+static void BENCH_QueuePing();
+static void BENCH_QueuePong();
+static void BENCH_IsrLatency();
+static void BENCH_IsrWaiter();
+static void BENCH_IsrTrigger();
+static void BENCH_IrqLatency(uint32_t mode);
+static void BENCH_Work(void *arg);
+static void BENCH_Timers();
+static void BENCH_TimerCallback(void *arg);
+static void BENCH_Ring();
+static void BENCH_ProtoRam();
+static void BENCH_ProtoSignal();
+static uint32_t BENCH_ProtoWaiter(proto_t *pt);
+static void BENCH_ProtoSignaller();
+static void BENCH_ProtoYield();
+static uint32_t BENCH_ProtoYielder(proto_t *pt);
+
+/* functions */
+bool BENCH_Run(const char *platform)
+{
+	
+	SCHEDULER_SemInit(&done, 0);
+	SCHEDULER_SemInit(&isr_sem, 0);
+	
+	if (!SWTIMER_Init(BENCH_PRIORITY - 1) || !PROTO_Init(BENCH_PRIORITY - 1) || !WORKQ_Init(BENCH_PRIORITY - 1))
+	{
+		BENCH_Error("service task not created");
+		return false;
+	}
+	
+	BENCH_Print("{\"suite\":\"scheduler\",\"platform\":\"");
+	BENCH_Print(platform);
+	BENCH_Print("\",\"core_hz\":");
+	BENCH_PrintNumber(SystemCoreClock);
+	BENCH_Print(",\"max_tasks\":");
+	BENCH_PrintNumber(MAX_TASKS);
+	BENCH_Print("}\n");
+	
+	// one-way cost of a yield, from one task calling it to the next resuming
+	BENCH_Switch(2);
+	BENCH_Report("yield_pingpong", "tasks", 2);
+	
+	uint32_t tasks;
+	for (tasks = 2; tasks < BENCH_WORKERS; tasks *= 2)
+	{
+		BENCH_Switch(tasks);
+		BENCH_Report("switch", "tasks", tasks);
+	}
+	
+	BENCH_Switch(BENCH_WORKERS);
+	BENCH_Report("switch", "tasks", BENCH_WORKERS);
+	
+	BENCH_Wakeup();
+	BENCH_Report("wait_release", 0, 0);
+	
+	BENCH_Queue();
+	BENCH_Report("queue_roundtrip", "tasks", 2);
+	
+	BENCH_IsrLatency();
+	BENCH_Report("isr_to_task", 0, 0);
+	
+	// how long an interrupt at the same priority waits behind a handler
+	// doing BENCH_WORK_CYCLES of work, then behind one deferring it
+	BENCH_IrqLatency(BENCH_ISR_INLINE);
+	BENCH_Report("irq_latency_inline", "work_cycles", BENCH_WORK_CYCLES);
+	
+	BENCH_IrqLatency(BENCH_ISR_DEFERRED);
+	BENCH_Report("irq_latency_deferred", "work_cycles", BENCH_WORK_CYCLES);
+	
+	BENCH_IrqLatency(BENCH_ISR_POST);
+	BENCH_Report("workq_dispatch", 0, 0);
+	
+	BENCH_ProtoRam();
+	
+	BENCH_ProtoYield();
+	BENCH_Report("proto_yield", "protos", 2);
+	
+	BENCH_ProtoSignal();
+	BENCH_Report("proto_signal", 0, 0);
+	
+	BENCH_Timers();
+	
+	BENCH_Ring();
+	
+	BENCH_Print("{\"done\":1}\n");
+	
+	return true;
+	
+}
+
+void BENCH_Error(const char *error)
+{
+	
+	BENCH_Print("{\"error\":\"");
+	BENCH_Print(error);
+	BENCH_Print("\"}\n");
+	
+}
+
+static void BENCH_Reset()
+{
+	
+	result.count = 0;
+	result.min = 0xFFFFFFFF;
+	result.max = 0;
+	result.sum = 0;
+	stamp = 0;
+	
+}
+
+static void BENCH_Sample(uint32_t cycles)
+{
+	
+	result.count++;
+	result.sum += cycles;
+	
+	if (cycles < result.min)
+	{
+		result.min = cycles;
+	}
+	
+	if (cycles > result.max)
+	{
+		result.max = cycles;
+	}
+	
+}
+
+static void BENCH_Report(const char *name, const char *param, uint32_t value)
+{
+	
+	BENCH_Print("{\"bench\":\"");
+	BENCH_Print(name);
+	BENCH_Print("\",");
+	
+	if (param)
+	{
+		BENCH_Print("\"");
+		BENCH_Print(param);
+		BENCH_Print("\":");
+		BENCH_PrintNumber(value);
+		BENCH_Print(",");
+	}
+	
+	BENCH_Print("\"samples\":");
+	BENCH_PrintNumber(result.count);
+	BENCH_Print(",\"min\":");
+	BENCH_PrintNumber(result.count ? result.min : 0);
+	BENCH_Print(",\"mean\":");
+	BENCH_PrintNumber(result.count ? result.sum / result.count : 0);
+	BENCH_Print(",\"max\":");
+	BENCH_PrintNumber(result.max);
+	BENCH_Print("}\n");
+	
+}
+
+static void BENCH_Print(const char *text)
+{
+	
+	while (*text)
+	{
+		BENCH_Putc(*text++);
+	}
+	
+}
+
+static void BENCH_PrintNumber(uint64_t value)
+{
+	
+	char digits[20];
+	int count = 0;
+	
+	do
+	{
+		digits[count++] = '0' + value % 10;
+		value /= 10;
+	}
+	while (value);
+	
+	while (count)
+	{
+		BENCH_Putc(digits[--count]);
+	}
+	
+}
+
+/* starts a worker in the first free stack, they are reused once a worker exits */
+static bool BENCH_Spawn(void *entry_point, uint32_t priority)
+{
+	
+	static uint32_t next = 0;
+	
+	workers[next].stack_start = worker_stacks[next];
+	workers[next].stack_size = sizeof(worker_stacks[next]);
+	
+	if (!SCHEDULER_TaskInit(&workers[next], entry_point, priority))
+	{
+		return false;
+	}
+	
+	next = (next + 1) % BENCH_WORKERS;
+	
+	return true;
+	
+}
+
+/* the last worker to finish wakes the suite */
+static void BENCH_Finish()
+{
+	
+	INT_Disable();
+	
+	if (--running == 0)
+	{
+		SCHEDULER_SemGive(&done);
+	}
+	
+	INT_Enable();
+	
+}
+
+/*
+ * Blocks until the last worker is done, then lets the workers that are left
+ * return and free their slots and stacks before the next benchmark.
+ */
+static void BENCH_Wait()
+{
+	
+	SCHEDULER_SemTake(&done);
+	SCHEDULER_Sleep(2);
+	
+}
+
+/*
+ * tasks workers at one priority yield round-robin; each sample is the time
+ * from one worker's yield to the next one running.
+ */
+static void BENCH_Switch(uint32_t tasks)
+{
+	
+	BENCH_Reset();
+	rounds = BENCH_SAMPLES / tasks + 1;
+	running = tasks;
+	
+	uint32_t i;
+	for (i = 0; i < tasks; i++)
+	{
+		BENCH_Spawn(BENCH_SwitchTask, 1);
+	}
+	
+	BENCH_Wait();
+	
+}
+
+static void BENCH_SwitchTask()
+{
+	
+	uint32_t i;
+	for (i = 0; i < rounds; i++)
+	{
+		
+		uint32_t now = DWT_CycleCount();
+		
+		if (stamp)
+		{
+			BENCH_Sample(now - stamp);
+		}
+		
+		stamp = DWT_CycleCount();
+		SCHEDULER_Yield();
+		
+	}
+	
+	// the exit path is not part of the measurement
+	stamp = 0;
+	BENCH_Finish();
+	
+}
+
+/*
+ * A low priority task releases a flag a high priority one waits on; each
+ * sample runs from the release to the waiter running.
+ */
+static void BENCH_Wakeup()
+{
+	
+	BENCH_Reset();
+	running = 1;
+	
+	BENCH_Spawn(BENCH_WakeupWaiter, BENCH_PRIORITY - 1);
+	BENCH_Spawn(BENCH_WakeupReleaser, 1);
+	
+	BENCH_Wait();
+	
+}
+
+static void BENCH_WakeupWaiter()
+{
+	
+	uint32_t i;
+	for (i = 0; i < BENCH_SAMPLES; i++)
+	{
+		
+		SCHEDULER_Wait(BENCH_FLAG);
+		BENCH_Sample(DWT_CycleCount() - stamp);
+		
+	}
+	
+	BENCH_Finish();
+	
+}
+
+static void BENCH_WakeupReleaser()
+{
+	
+	uint32_t i;
+	for (i = 0; i < BENCH_SAMPLES; i++)
+	{
+		
+		stamp = DWT_CycleCount();
+		SCHEDULER_Release(BENCH_FLAG);
+		
+	}
+	
+}
+
+/*
+ * Two tasks at one priority pass a pointer back and forth through a pair of
+ * queues; each sample is a full round trip, two sends, two receives and the
+ * two switches between them.
+ */
+static void BENCH_Queue()
+{
+	
+	BENCH_Reset();
+	running = 1;
+	
+	SCHEDULER_QueueInit(&queues[0], queue_slots[0], 1);
+	SCHEDULER_QueueInit(&queues[1], queue_slots[1], 1);
+	
+	BENCH_Spawn(BENCH_QueuePong, 1);
+	BENCH_Spawn(BENCH_QueuePing, 1);
+	
+	BENCH_Wait();
+	
+}
+
+static void BENCH_QueuePing()
+{
+	
+	void *msg = &result;
+	
+	uint32_t i;
+	for (i = 0; i < BENCH_SAMPLES; i++)
+	{
+		
+		uint32_t start = DWT_CycleCount();
+		SCHEDULER_QueueSend(&queues[0], msg, WAIT_FOREVER);
+		SCHEDULER_QueueReceive(&queues[1], &msg, WAIT_FOREVER);
+		BENCH_Sample(DWT_CycleCount() - start);
+		
+	}
+	
+	BENCH_Finish();
+	
+}
+
+static void BENCH_QueuePong()
+{
+	
+	void *msg;
+	
+	uint32_t i;
+	for (i = 0; i < BENCH_SAMPLES; i++)
+	{
+		
+		SCHEDULER_QueueReceive(&queues[0], &msg, WAIT_FOREVER);
+		SCHEDULER_QueueSend(&queues[1], msg, WAIT_FOREVER);
+		
+	}
+	
+}
+
+/*
+ * An interrupt gives a semaphore a high priority task is blocked on; each
+ * sample runs from the give inside the interrupt to the task running.
+ */
+static void BENCH_IsrLatency()
+{
+	
+	BENCH_Reset();
+	running = 1;
+	isr_mode = BENCH_ISR_WAKE;
+	
+	BENCH_Spawn(BENCH_IsrWaiter, BENCH_PRIORITY - 1);
+	BENCH_Spawn(BENCH_IsrTrigger, 1);
+	
+	BENCH_Wait();
+	
+}
+
+void BENCH_Isr()
+{
+	
+	switch (isr_mode)
+	{
+		
+		case BENCH_ISR_WAKE:
+			stamp = DWT_CycleCount();
+			SCHEDULER_SemGive(&isr_sem);
+			break;
+		
+		case BENCH_ISR_INLINE:
+			probe_stamp = DWT_CycleCount();
+			BENCH_TriggerProbe();
+			BENCH_Work(0);
+			break;
+		
+		case BENCH_ISR_DEFERRED:
+			probe_stamp = DWT_CycleCount();
+			BENCH_TriggerProbe();
+			WORKQ_Post(0, BENCH_Work, 0);
+			break;
+		
+		default:
+			stamp = DWT_CycleCount();
+			WORKQ_Post(0, BENCH_Work, (void*)1);
+			break;
+		
+	}
+	
+}
+
+void BENCH_Probe()
+{
+	
+	BENCH_Sample(DWT_CycleCount() - probe_stamp);
+	
+}
+
+static void BENCH_IsrWaiter()
+{
+	
+	uint32_t i;
+	for (i = 0; i < BENCH_SAMPLES; i++)
+	{
+		
+		SCHEDULER_SemTake(&isr_sem);
+		BENCH_Sample(DWT_CycleCount() - stamp);
+		
+	}
+	
+	BENCH_Finish();
+	
+}
+
+static void BENCH_IsrTrigger()
+{
+	
+	uint32_t i;
+	for (i = 0; i < BENCH_SAMPLES; i++)
+	{
+		BENCH_TriggerIsr();
+	}
+	
+	if (isr_mode != BENCH_ISR_WAKE)
+	{
+		BENCH_Finish();
+	}
+	
+}
+
+/*
+ * Interrupt latency with and without deferral: BENCH_Isr pends a probe
+ * interrupt of the same priority and then either does the work itself or
+ * posts it, and each sample runs from the pend to the probe running. With
+ * BENCH_ISR_POST the samples are instead from the post to the work item
+ * starting in the worker task.
+ */
+static void BENCH_IrqLatency(uint32_t mode)
+{
+	
+	BENCH_Reset();
+	running = 1;
+	isr_mode = mode;
+	
+	BENCH_Spawn(BENCH_IsrTrigger, 1);
+	
+	BENCH_Wait();
+	
+}
+
+/* stands in for a handler's work, e.g. a DMA completion callback */
+static void BENCH_Work(void *arg)
+{
+	
+	uint32_t start = DWT_CycleCount();
+	
+	if (arg)
+	{
+		BENCH_Sample(start - stamp);
+	}
+	
+	while (DWT_CycleCount() - start < BENCH_WORK_CYCLES);
+	
+}
+
+/*
+ * Arms BENCH_TIMERS timers spread over all wheel levels, cancels them, then
+ * arms them all for the same tick and times the service task dispatching
+ * their callbacks one after another.
+ */
+static void BENCH_Timers()
+{
+	
+	uint32_t i;
+	for (i = 0; i < BENCH_TIMERS; i++)
+	{
+		SWTIMER_Create(&timers[i], BENCH_TimerCallback, 0);
+	}
+	
+	BENCH_Reset();
+	
+	for (i = 0; i < BENCH_TIMERS; i++)
+	{
+		
+		uint32_t delay = 1 + (i * 7919) % (SWTIMER_MAX_DELAY - 1);
+		uint32_t start = DWT_CycleCount();
+		SWTIMER_Start(&timers[i], delay, 0);
+		BENCH_Sample(DWT_CycleCount() - start);
+		
+	}
+	
+	BENCH_Report("swtimer_start", "timers", BENCH_TIMERS);
+	BENCH_Reset();
+	
+	for (i = 0; i < BENCH_TIMERS; i++)
+	{
+		
+		uint32_t start = DWT_CycleCount();
+		SWTIMER_Stop(&timers[i]);
+		BENCH_Sample(DWT_CycleCount() - start);
+		
+	}
+	
+	BENCH_Report("swtimer_stop", "timers", BENCH_TIMERS);
+	BENCH_Reset();
+	
+	running = BENCH_TIMERS;
+	
+	INT_Disable();
+	
+	for (i = 0; i < BENCH_TIMERS; i++)
+	{
+		SWTIMER_Start(&timers[i], 2, 0);
+	}
+	
+	INT_Enable();
+	
+	BENCH_Wait();
+	BENCH_Report("swtimer_expire", "timers", BENCH_TIMERS);
+	
+}
+
+static void BENCH_TimerCallback(void *arg)
+{
+	
+	uint32_t now = DWT_CycleCount();
+	
+	if (stamp)
+	{
+		BENCH_Sample(now - stamp);
+	}
+	
+	stamp = now;
+	BENCH_Finish();
+	
+}
+
+/* cost of moving BENCH_CHUNK bytes through a ring buffer, and of one byte */
+static void BENCH_Ring()
+{
+	
+	uint8_t chunk[BENCH_CHUNK];
+	uint8_t byte = 0;
+	
+	RINGBUF_Init(&ring, ring_buffer, sizeof(ring_buffer), false);
+	BENCH_Reset();
+	
+	uint32_t i;
+	for (i = 0; i < BENCH_SAMPLES; i++)
+	{
+		
+		// offset by a few bytes per round so the copies wrap now and then
+		RINGBUF_Write(&ring, chunk, i % 8);
+		RINGBUF_Read(&ring, chunk, i % 8);
+		
+		uint32_t start = DWT_CycleCount();
+		RINGBUF_Write(&ring, chunk, BENCH_CHUNK);
+		RINGBUF_Read(&ring, chunk, BENCH_CHUNK);
+		BENCH_Sample(DWT_CycleCount() - start);
+		
+	}
+	
+	BENCH_Report("ringbuf_chunk", "bytes", BENCH_CHUNK);
+	BENCH_Reset();
+	
+	for (i = 0; i < BENCH_SAMPLES; i++)
+	{
+		
+		uint32_t start = DWT_CycleCount();
+		RINGBUF_Put(&ring, byte);
+		RINGBUF_Get(&ring, &byte);
+		BENCH_Sample(DWT_CycleCount() - start);
+		
+	}
+	
+	BENCH_Report("ringbuf_byte", "bytes", 1);
+	
+}
+
+/*
+ * RAM per protothread against a preemptive task with the default stack. The
+ * dispatcher's stack is paid once, however many protothreads share it.
+ */
+static void BENCH_ProtoRam()
+{
+	
+	BENCH_Print("{\"bench\":\"ram\",\"proto_bytes\":");
+	BENCH_PrintNumber(sizeof(proto_t));
+	BENCH_Print(",\"proto_shared_stack\":");
+	BENCH_PrintNumber(PROTO_STACK_SIZE);
+	BENCH_Print(",\"task_bytes\":");
+	BENCH_PrintNumber(sizeof(task_table_t) + sizeof(task_state_t) + TASK_STACK_SIZE);
+	BENCH_Print("}\n");
+	
+}
+
+/*
+ * Two protothreads yield to each other, the stackless counterpart of
+ * yield_pingpong; each sample runs from one yield to the other resuming.
+ */
+static void BENCH_ProtoYield()
+{
+	
+	BENCH_Reset();
+	rounds = BENCH_SAMPLES / 2 + 1;
+	running = 2;
+	
+	proto_rounds[0] = 0;
+	proto_rounds[1] = 0;
+	PROTO_Start(&protos[0], BENCH_ProtoYielder, 0);
+	PROTO_Start(&protos[1], BENCH_ProtoYielder, 0);
+	
+	BENCH_Wait();
+	
+}
+
+static uint32_t BENCH_ProtoYielder(proto_t *pt)
+{
+	
+	// set again on every call, locals do not survive a yield
+	uint32_t *round = &proto_rounds[pt - protos];
+	
+	PROTO_BEGIN(pt);
+	
+	while (*round < rounds)
+	{
+		
+		uint32_t now = DWT_CycleCount();
+		
+		if (stamp)
+		{
+			BENCH_Sample(now - stamp);
+		}
+		
+		(*round)++;
+		stamp = DWT_CycleCount();
+		PROTO_YIELD(pt);
+		
+	}
+	
+	stamp = 0;
+	BENCH_Finish();
+	
+	PROTO_END(pt);
+	
+}
+
+/*
+ * The protothread counterpart of wait_release: a low priority task signals
+ * a protothread, each sample runs from the signal to the protothread
+ * running, dispatcher switch included.
+ */
+static void BENCH_ProtoSignal()
+{
+	
+	BENCH_Reset();
+	running = 1;
+	
+	PROTO_Start(&protos[0], BENCH_ProtoWaiter, 0);
+	BENCH_Spawn(BENCH_ProtoSignaller, 1);
+	
+	BENCH_Wait();
+	
+}
+
+static uint32_t BENCH_ProtoWaiter(proto_t *pt)
+{
+	
+	static uint32_t i;
+	static uint32_t bits;
+	
+	PROTO_BEGIN(pt);
+	
+	for (i = 0; i < BENCH_SAMPLES; i++)
+	{
+		
+		PROTO_WAIT_SIGNAL(pt, bits);
+		BENCH_Sample(DWT_CycleCount() - stamp);
+		
+	}
+	
+	BENCH_Finish();
+	
+	PROTO_END(pt);
+	
+}
+
+static void BENCH_ProtoSignaller()
+{
+	
+	uint32_t i;
+	for (i = 0; i < BENCH_SAMPLES; i++)
+	{
+		
+		stamp = DWT_CycleCount();
+		PROTO_Signal(&protos[0], 1);
+		
+	}
+	
+}
\ No newline at end of file
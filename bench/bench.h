@@ -0,0 +1,45 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "scheduler.h"
+
+#ifdef SCHEDULER_EDF
+#define BENCH_PRIORITY 		(EDF_PRIORITY - 1) // the task running the suite, below the periodic tasks
+#else
+#define BENCH_PRIORITY 		(PRIORITY_LEVELS - 1) // the task running the suite
+#endif
+#define BENCH_SAMPLES 		1000 // per benchmark
+#define BENCH_TIMERS 			1000
+#define BENCH_STACK_SIZE 	TASK_STACK_SIZE
+#define BENCH_CHUNK 			64 // bytes per ring buffer write/read
+#define BENCH_WORK_CYCLES 	2000 // handler work done inline or deferred in the latency benchmarks
+
+typedef struct
+{
+	
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	
+} bench_result_t;
+
+// runs every benchmark and prints one JSON object per line, call from a task at BENCH_PRIORITY;
+// false if the suite could not be set up
+bool BENCH_Run(const char *platform);
+// prints {"error":"<error>"} on a line of its own
+void BENCH_Error(const char *error);
+// the ISR side of the ISR-to-task benchmark, the port calls it from its interrupt
+void BENCH_Isr();
+// the probe interrupt of the latency benchmarks, at the same NVIC priority as BENCH_Isr's
+void BENCH_Probe();
+
+// provided per platform by bench_cm3.c and bench_posix.c
+void BENCH_Putc(char c);
+void BENCH_TriggerIsr();
+void BENCH_TriggerProbe(); // pends the probe, it runs once BENCH_Isr returns
+
+#endif
\ No newline at end of file
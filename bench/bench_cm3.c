@@ -0,0 +1,98 @@
+#include "bench.h"
+
+#include "efm32.h"
+#include "efm32_chip.h"
+#include "efm32_cmu.h"
+
+#include "scheduler.h"
+#include "trace.h"
+
+#define BENCH_IRQn 			DAC0_IRQn // unused by the suite, pended from software
+#define PROBE_IRQn 			ACMP0_IRQn // likewise, same priority as BENCH_IRQn
+
+/*
+ * Benchmark firmware. Results go out as text on ITM stimulus port 0 over
+ * SWO, set up by TRACE_Init; capture them with any SWO viewer at the rate
+ * given by TRACE_SWO_PRESCALER.
+ */
+
+SCHEDULER_TASK_DEFINE(bench_task, BENCH_STACK_SIZE);
+
+void BENCH_Putc(char c)
+{
+	
+	ITM_SendChar(c);
+	
+}
+
+void BENCH_TriggerIsr()
+{
+	
+	NVIC_SetPendingIRQ(BENCH_IRQn);
+	
+}
+
+void BENCH_TriggerProbe()
+{
+	
+	NVIC_SetPendingIRQ(PROBE_IRQn);
+	
+}
+
+void DAC0_IRQHandler()
+{
+	
+	BENCH_Isr();
+	
+}
+
+void ACMP0_IRQHandler()
+{
+	
+	BENCH_Probe();
+	
+}
+
+static void BENCH_Task()
+{
+	
+	BENCH_Run("cm3");
+	
+	while (1)
+	{
+		SCHEDULER_Sleep(WAIT_FOREVER);
+	}
+	
+}
+
+int main()
+{
+	
+	// Chip errata
+	CHIP_Init();
+	
+	// run from the crystal so cycle counts match the production clock
+	CMU_OscillatorEnable(cmuOsc_HFXO, true, true);
+	CMU_ClockSelectSet(cmuClock_HF, cmuSelect_HFXO);
+	CMU_ClockEnable(cmuClock_GPIO, true);
+	SystemCoreClockUpdate();
+	
+	TRACE_Init(true);
+	ITM->TER |= 1;
+	
+	SCHEDULER_Init();
+	
+	NVIC_ClearPendingIRQ(BENCH_IRQn);
+	NVIC_EnableIRQ(BENCH_IRQn);
+	NVIC_ClearPendingIRQ(PROBE_IRQn);
+	NVIC_EnableIRQ(PROBE_IRQn);
+	
+	if (!SCHEDULER_TaskInit(&bench_task, BENCH_Task, BENCH_PRIORITY))
+	{
+		BENCH_Error("bench task not created");
+		while (1);
+	}
+	
+	SCHEDULER_Run();
+	
+}
\ No newline at end of file
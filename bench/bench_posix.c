@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+
+#include "efm32.h"
+#include "efm32_int.h"
+
+#include "scheduler.h"
+
+/* hosted benchmark runner, results go to stdout */
+
+static uint32_t probe_pending = 0;
+
+SCHEDULER_TASK_DEFINE(bench_task, BENCH_STACK_SIZE);
+
+void BENCH_Putc(char c)
+{
+	
+	INT_Disable();
+	putchar(c);
+	INT_Enable();
+	
+}
+
+/*
+ * Runs BENCH_Isr the way port_posix.c runs the tick, then a probe it pended,
+ * as the NVIC would tail-chain two interrupts of the same priority.
+ */
+void BENCH_TriggerIsr()
+{
+	
+	INT_Disable();
+	port_in_isr = 1;
+	BENCH_Isr();
+	
+	if (probe_pending)
+	{
+		probe_pending = 0;
+		BENCH_Probe();
+	}
+	
+	port_in_isr = 0;
+	INT_Enable();
+	
+}
+
+void BENCH_TriggerProbe()
+{
+	
+	probe_pending = 1;
+	
+}
+
+static void BENCH_Task()
+{
+	
+	bool passed = BENCH_Run("posix");
+	
+	INT_Disable();
+	fflush(stdout);
+	exit(passed ? 0 : 1);
+	
+}
+
+int main()
+{
+	
+	SCHEDULER_Init();
+	
+	if (!SCHEDULER_TaskInit(&bench_task, BENCH_Task, BENCH_PRIORITY))
+	{
+		BENCH_Error("bench task not created");
+		return 1;
+	}
+	
+	SCHEDULER_Run();
+	
+	return 0;
+	
+}
\ No newline at end of file
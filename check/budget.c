@@ -0,0 +1,87 @@
+#include "check.h"
+
+#define CHECK_BUDGET 			2 // ticks of CPU the spinner gets
+#define CHECK_PERIOD 			10 // in every so many ticks
+
+/*
+ * CPU budgets: a task that spins at a high priority with a budget is
+ * throttled each time it uses it up, counted as an overrun every period,
+ * and a lower priority task that would otherwise starve still gets the CPU
+ * for the rest of each period.
+ */
+
+/* variables */
+static volatile uint32_t low_count = 0;
+SCHEDULER_TASK_DEFINE(spin_task, TASK_STACK_SIZE);
+SCHEDULER_TASK_DEFINE(low_task, TASK_STACK_SIZE);
+SCHEDULER_TASK_DEFINE(check_task, TASK_STACK_SIZE);
+
+/* prototypes */
+static void CHECK_Task();
+static void CHECK_Spin();
+static void CHECK_Low();
+
+/* functions */
+int main()
+{
+	
+	SCHEDULER_Init();
+	
+	SCHEDULER_TaskInit(&check_task, CHECK_Task, CHECK_PRIORITY);
+	SCHEDULER_Run();
+	
+	return 0;
+	
+}
+
+static void CHECK_Task()
+{
+	
+	CHECK(!SCHEDULER_SetBudget(&spin_task, CHECK_PERIOD, CHECK_PERIOD));
+	CHECK(SCHEDULER_TaskInit(&low_task, CHECK_Low, 1));
+	CHECK(SCHEDULER_TaskInit(&spin_task, CHECK_Spin, CHECK_PRIORITY - 1));
+	CHECK(SCHEDULER_SetBudget(&spin_task, CHECK_BUDGET, CHECK_PERIOD));
+	
+	SCHEDULER_Sleep(5 * CHECK_PERIOD);
+	
+	uint32_t overruns = SCHEDULER_Overruns(&spin_task);
+	uint32_t count = low_count;
+	CHECK(overruns >= 3);
+	CHECK(count > 0);
+	
+	SCHEDULER_Sleep(5 * CHECK_PERIOD);
+	
+	CHECK(SCHEDULER_Overruns(&spin_task) >= overruns + 3);
+	CHECK(low_count > count);
+	
+	// without a budget the spinner starves the low priority task again
+	CHECK(SCHEDULER_SetBudget(&spin_task, 0, 0));
+	SCHEDULER_Sleep(CHECK_PERIOD);
+	
+	overruns = SCHEDULER_Overruns(&spin_task);
+	count = low_count;
+	SCHEDULER_Sleep(5 * CHECK_PERIOD);
+	
+	CHECK(SCHEDULER_Overruns(&spin_task) == overruns);
+	CHECK(low_count == count);
+	
+	CHECK_PASS("budget");
+	
+}
+
+static void CHECK_Spin()
+{
+	
+	while (1);
+	
+}
+
+static void CHECK_Low()
+{
+	
+	while (1)
+	{
+		low_count++;
+	}
+	
+}
\ No newline at end of file
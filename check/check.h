@@ -0,0 +1,26 @@
+#ifndef __CHECK_H__
+#define __CHECK_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "efm32_int.h"
+
+#include "scheduler.h"
+
+/*
+ * Hosted kernel checks, one program per file in check/, built and run by
+ * 'make check-hosted'. Each one runs its scenario as tasks on the hosted
+ * port and exits 0 once everything held, 1 at the first CHECK that did not.
+ * Output goes through printf with interrupts masked, as port_posix.c asks.
+ */
+
+#define CHECK_PRIORITY 		(PRIORITY_LEVELS - 2) // task driving a check, below EDF_PRIORITY
+
+#define CHECK(cond) \
+	do { if (!(cond)) { INT_Disable(); printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); exit(1); } } while (0)
+
+#define CHECK_PASS(name) \
+	do { INT_Disable(); printf("%s: ok\n", (name)); exit(0); } while (0)
+
+#endif
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "check.h"
+
+#define CHECK_TICKS 			200 // ticks the admitted set runs for
+
+/*
+ * EDF admission and deadline misses: periodic tasks are admitted while their
+ * total density stays within 1.0 and one more that would push it over is
+ * refused. The admitted set, each job doing less than its wcet, runs without
+ * a miss. A job that overruns is counted as a miss by the tick while it is
+ * still running, and only once when it finally completes.
+ */
+
+/* variables */
+static volatile uint32_t jobs[3];
+static volatile uint32_t overrun_seen = 0; // misses the overrunning job saw while still running
+SCHEDULER_TASK_DEFINE(periodic_task0, TASK_STACK_SIZE);
+SCHEDULER_TASK_DEFINE(periodic_task1, TASK_STACK_SIZE);
+SCHEDULER_TASK_DEFINE(periodic_task2, TASK_STACK_SIZE);
+SCHEDULER_TASK_DEFINE(extra_task, TASK_STACK_SIZE);
+SCHEDULER_TASK_DEFINE(overrun_task, TASK_STACK_SIZE);
+SCHEDULER_TASK_DEFINE(check_task, TASK_STACK_SIZE);
+
+/* prototypes */
+static void CHECK_Task();
+static void CHECK_Periodic0();
+static void CHECK_Periodic1();
+static void CHECK_Periodic2();
+static void CHECK_Job(uint32_t n);
+static void CHECK_Overrun();
+
+/* functions */
+int main()
+{
+	
+	SCHEDULER_Init();
+	
+	SCHEDULER_TaskInit(&check_task, CHECK_Task, CHECK_PRIORITY);
+	SCHEDULER_Run();
+	
+	return 0;
+	
+}
+
+static void CHECK_Task()
+{
+	
+	// 2/10 + 3/15 + 10/20 = 0.9, another 2/10 would make 1.1
+	CHECK(SCHEDULER_TaskInitPeriodic(&periodic_task0, CHECK_Periodic0, 2, 10, 10));
+	CHECK(SCHEDULER_TaskInitPeriodic(&periodic_task1, CHECK_Periodic1, 3, 15, 15));
+	CHECK(SCHEDULER_TaskInitPeriodic(&periodic_task2, CHECK_Periodic2, 10, 25, 20));
+	CHECK(!SCHEDULER_TaskInitPeriodic(&extra_task, CHECK_Periodic0, 2, 10, 10));
+	CHECK(!SCHEDULER_TaskInitPeriodic(&extra_task, CHECK_Periodic0, 5, 10, 4));
+	CHECK(!SCHEDULER_TaskInit(&extra_task, CHECK_Periodic0, EDF_PRIORITY));
+	
+	SCHEDULER_Sleep(CHECK_TICKS);
+	
+	CHECK(SCHEDULER_DeadlineMisses(&periodic_task0) == 0);
+	CHECK(SCHEDULER_DeadlineMisses(&periodic_task1) == 0);
+	CHECK(SCHEDULER_DeadlineMisses(&periodic_task2) == 0);
+	CHECK(jobs[0] >= CHECK_TICKS / 10 - 1);
+	CHECK(jobs[1] >= CHECK_TICKS / 15 - 1);
+	CHECK(jobs[2] >= CHECK_TICKS / 25 - 1);
+	
+	// deleting the set gives its density back
+	CHECK(SCHEDULER_TaskDelete(&periodic_task0));
+	CHECK(SCHEDULER_TaskDelete(&periodic_task1));
+	CHECK(SCHEDULER_TaskDelete(&periodic_task2));
+	CHECK(SCHEDULER_TaskInitPeriodic(&overrun_task, CHECK_Overrun, 2, 50, 5));
+	
+	SCHEDULER_Sleep(60);
+	
+	CHECK(overrun_seen == 1);
+	CHECK(SCHEDULER_DeadlineMisses(&overrun_task) == 1);
+	
+	CHECK_PASS("edf");
+	
+}
+
+static void CHECK_Periodic0()
+{
+	
+	CHECK_Job(0);
+	
+}
+
+static void CHECK_Periodic1()
+{
+	
+	CHECK_Job(1);
+	
+}
+
+static void CHECK_Periodic2()
+{
+	
+	CHECK_Job(2);
+	
+}
+
+/* every job spins into the next tick, well within each task's wcet */
+static void CHECK_Job(uint32_t n)
+{
+	
+	while (1)
+	{
+		
+		uint32_t start = SCHEDULER_GetTicks();
+		while (SCHEDULER_GetTicks() == start);
+		
+		jobs[n]++;
+		SCHEDULER_WaitNextPeriod();
+		
+	}
+	
+}
+
+/* the first job runs past its deadline at release + 5, the second is on time */
+static void CHECK_Overrun()
+{
+	
+	uint32_t start = SCHEDULER_GetTicks();
+	while (SCHEDULER_GetTicks() - start < 10);
+	
+	overrun_seen = SCHEDULER_DeadlineMisses(&overrun_task);
+	SCHEDULER_WaitNextPeriod();
+	SCHEDULER_WaitNextPeriod();
+	
+	while (1)
+	{
+		SCHEDULER_WaitNextPeriod();
+	}
+	
+}
\ No newline at end of file
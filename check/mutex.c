@@ -0,0 +1,167 @@
+#include "check.h"
+
+/*
+ * Mutex priority inheritance: a holder runs at the priority of its highest
+ * waiter, across the mutexes it holds and along a chain of holders blocked
+ * on one another, drops back once it has unlocked them all, and gives up
+ * what a waiter lent it when that waiter is deleted.
+ */
+
+/* variables */
+static mutex_t a;
+static mutex_t b;
+static semaphore_t step;
+SCHEDULER_TASK_DEFINE(low_task, TASK_STACK_SIZE);
+SCHEDULER_TASK_DEFINE(mid_task, TASK_STACK_SIZE);
+SCHEDULER_TASK_DEFINE(high_task, TASK_STACK_SIZE);
+SCHEDULER_TASK_DEFINE(top_task, TASK_STACK_SIZE);
+SCHEDULER_TASK_DEFINE(check_task, TASK_STACK_SIZE);
+
+/* prototypes */
+static void CHECK_Task();
+static uint32_t CHECK_Priority(task_t *task);
+static void CHECK_HoldBoth();
+static void CHECK_HoldA();
+static void CHECK_HoldBWaitA();
+static void CHECK_WaitA();
+static void CHECK_WaitB();
+
+/* functions */
+int main()
+{
+	
+	SCHEDULER_Init();
+	SCHEDULER_MutexInit(&a);
+	SCHEDULER_MutexInit(&b);
+	SCHEDULER_SemInit(&step, 0);
+	
+	SCHEDULER_TaskInit(&check_task, CHECK_Task, CHECK_PRIORITY);
+	SCHEDULER_Run();
+	
+	return 0;
+	
+}
+
+static void CHECK_Task()
+{
+	
+	// boost and unboost across two mutexes
+	CHECK(SCHEDULER_TaskInit(&low_task, CHECK_HoldBoth, 1));
+	SCHEDULER_Sleep(2);
+	CHECK(SCHEDULER_TaskInit(&high_task, CHECK_WaitA, 4));
+	SCHEDULER_Sleep(2);
+	CHECK(CHECK_Priority(&low_task) == 4);
+	CHECK(SCHEDULER_TaskInit(&top_task, CHECK_WaitB, 5));
+	SCHEDULER_Sleep(2);
+	CHECK(CHECK_Priority(&low_task) == 5);
+	
+	SCHEDULER_SemGive(&step); // unlocks b
+	SCHEDULER_Sleep(2);
+	CHECK(SCHEDULER_TaskJoin(&top_task, 2));
+	CHECK(CHECK_Priority(&low_task) >= 4);
+	
+	SCHEDULER_SemGive(&step); // unlocks a
+	SCHEDULER_Sleep(2);
+	CHECK(SCHEDULER_TaskJoin(&high_task, 2));
+	CHECK(CHECK_Priority(&low_task) == 1);
+	
+	SCHEDULER_SemGive(&step);
+	CHECK(SCHEDULER_TaskJoin(&low_task, 2));
+	
+	// low holds a, mid holds b and waits on a, high waits on a, top on b
+	CHECK(SCHEDULER_TaskInit(&low_task, CHECK_HoldA, 1));
+	SCHEDULER_Sleep(2);
+	CHECK(SCHEDULER_TaskInit(&mid_task, CHECK_HoldBWaitA, 2));
+	SCHEDULER_Sleep(2);
+	CHECK(SCHEDULER_TaskInit(&high_task, CHECK_WaitA, 4));
+	CHECK(SCHEDULER_TaskInit(&top_task, CHECK_WaitB, 5));
+	SCHEDULER_Sleep(2);
+	CHECK(CHECK_Priority(&mid_task) == 5);
+	CHECK(CHECK_Priority(&low_task) == 5);
+	
+	// deleting the waiters takes back what they lent, along the chain
+	CHECK(SCHEDULER_TaskDelete(&top_task));
+	CHECK(CHECK_Priority(&mid_task) == 2);
+	CHECK(CHECK_Priority(&low_task) == 4);
+	
+	CHECK(SCHEDULER_TaskDelete(&high_task));
+	CHECK(CHECK_Priority(&low_task) == 2);
+	
+	SCHEDULER_SemGive(&step); // low unlocks a, mid takes it and finishes
+	CHECK(SCHEDULER_TaskJoin(&low_task, 2));
+	CHECK(SCHEDULER_TaskJoin(&mid_task, 2));
+	CHECK(CHECK_Priority(&check_task) == CHECK_PRIORITY);
+	
+	CHECK_PASS("mutex");
+	
+}
+
+/* effective priority as reported by SCHEDULER_GetStats */
+static uint32_t CHECK_Priority(task_t *task)
+{
+	
+	task_stats_t stats[MAX_TASKS];
+	uint32_t count = SCHEDULER_GetStats(stats, MAX_TASKS);
+	
+	uint32_t i;
+	for (i = 0; i < count; i++)
+	{
+		
+		if (stats[i].task == task)
+		{
+			return stats[i].priority;
+		}
+		
+	}
+	
+	return PRIORITY_LEVELS;
+	
+}
+
+static void CHECK_HoldBoth()
+{
+	
+	SCHEDULER_MutexLock(&a);
+	SCHEDULER_MutexLock(&b);
+	SCHEDULER_SemTake(&step);
+	SCHEDULER_MutexUnlock(&b);
+	SCHEDULER_SemTake(&step);
+	SCHEDULER_MutexUnlock(&a);
+	SCHEDULER_SemTake(&step);
+	
+}
+
+static void CHECK_HoldA()
+{
+	
+	SCHEDULER_MutexLock(&a);
+	SCHEDULER_SemTake(&step);
+	SCHEDULER_MutexUnlock(&a);
+	
+}
+
+static void CHECK_HoldBWaitA()
+{
+	
+	SCHEDULER_MutexLock(&b);
+	SCHEDULER_MutexLock(&a);
+	SCHEDULER_MutexUnlock(&a);
+	SCHEDULER_MutexUnlock(&b);
+	
+}
+
+static void CHECK_WaitA()
+{
+	
+	SCHEDULER_MutexLock(&a);
+	SCHEDULER_MutexUnlock(&a);
+	
+}
+
+static void CHECK_WaitB()
+{
+	
+	SCHEDULER_MutexLock(&b);
+	SCHEDULER_MutexUnlock(&b);
+	
+}
\ No newline at end of file
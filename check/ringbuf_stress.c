@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+
+#include "efm32.h"
+#include "efm32_int.h"
+
+#include "scheduler.h"
+#include "ringbuf.h"
+#include "check.h"
+
+#define STRESS_SIZE 		64 // ring size, small so that it wraps every few ticks
+#define STRESS_BYTES 		20000 // total the producer writes
+#define STRESS_BURST 		97 // longest write per tick, more than the ring holds
+#define STRESS_CHUNK 		17 // longest read per call
+#define STRESS_PRIORITY 	2
+#define STRESS_STALL 		200 // ticks with data pending and no reads before a lost wakeup is assumed
+
+/*
+ * Hosted ring buffer stress check, built and run by 'make check-hosted'. The
+ * producer runs in the tick signal, as an ISR would on the target, and
+ * writes bursts of a numbered byte stream of varying length, partly with
+ * RINGBUF_Put. The consumer task blocks in RINGBUF_WaitData whenever the ring
+ * is empty and reads chunks of varying length back, checking every byte
+ * against its position in the stream. head and tail start just short of
+ * 2^32 so that the free running counters wrap as well as the indices. A
+ * consumer left blocked with data in the ring fails the check.
+ */
+
+/* variables */
+static ringbuf_t rb;
+static uint8_t rb_buffer[STRESS_SIZE];
+static volatile uint32_t produced = 0;
+static volatile uint32_t consumed = 0;
+static uint32_t stall_consumed = 0;
+static uint32_t stall_ticks = 0;
+static uint32_t waits = 0;
+static uint32_t seed = 1;
+static struct sigaction port_tick;
+SCHEDULER_TASK_DEFINE(consumer_task, TASK_STACK_SIZE);
+
+/* prototypes */
+static void STRESS_Tick(int signal);
+static void STRESS_Produce();
+static void STRESS_Consumer();
+static uint32_t STRESS_Random(uint32_t range);
+static uint8_t STRESS_Byte(uint32_t n);
+
+/* functions */
+int main()
+{
+	
+	SCHEDULER_Init();
+	RINGBUF_Init(&rb, rb_buffer, STRESS_SIZE, true);
+	rb.head = 0xFFFFFF00;
+	rb.tail = 0xFFFFFF00;
+	
+	SCHEDULER_TaskInit(&consumer_task, STRESS_Consumer, STRESS_PRIORITY);
+	SCHEDULER_Run();
+	
+	return 0;
+	
+}
+
+/* chained in front of the port's tick, masked like it while INT_LockCnt is held */
+static void STRESS_Tick(int signal)
+{
+	
+	if (!INT_LockCnt)
+	{
+		
+		INT_LockCnt = 1;
+		port_in_isr = 1;
+		STRESS_Produce();
+		port_in_isr = 0;
+		
+		if (consumed != stall_consumed || RINGBUF_Count(&rb) == 0)
+		{
+			stall_consumed = consumed;
+			stall_ticks = 0;
+		}
+		else if (++stall_ticks == STRESS_STALL)
+		{
+			printf("ringbuf_stress: consumer stalled at byte %u with %u bytes pending\n", consumed, RINGBUF_Count(&rb));
+			exit(1);
+		}
+		
+		INT_LockCnt = 0;
+		
+	}
+	
+	port_tick.sa_handler(signal);
+	
+}
+
+static void STRESS_Produce()
+{
+	
+	uint8_t burst[STRESS_BURST];
+	uint32_t length = 1 + STRESS_Random(STRESS_BURST);
+	
+	if (length > STRESS_BYTES - produced)
+	{
+		length = STRESS_BYTES - produced;
+	}
+	
+	uint32_t i;
+	for (i = 0; i < length; i++)
+	{
+		burst[i] = STRESS_Byte(produced + i);
+	}
+	
+	// alternate between byte and block writes, both stop once the ring is full
+	if (length & 1)
+	{
+		
+		for (i = 0; i < length; i++)
+		{
+			
+			if (!RINGBUF_Put(&rb, burst[i]))
+			{
+				break;
+			}
+			
+		}
+		
+		produced += i;
+		
+	}
+	else
+	{
+		produced += RINGBUF_Write(&rb, burst, length);
+	}
+	
+}
+
+static void STRESS_Consumer()
+{
+	
+	// the port's handler is in place once the scheduler runs
+	struct sigaction action;
+	action.sa_handler = STRESS_Tick;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGALRM, &action, &port_tick);
+	
+	while (consumed < STRESS_BYTES)
+	{
+		
+		uint8_t chunk[STRESS_CHUNK];
+		uint32_t length;
+		
+		if (RINGBUF_Count(&rb) == 0)
+		{
+			waits++;
+		}
+		
+		RINGBUF_WaitData(&rb);
+		
+		if (STRESS_Random(4) == 0)
+		{
+			length = RINGBUF_Get(&rb, chunk) ? 1 : 0;
+		}
+		else
+		{
+			length = RINGBUF_Read(&rb, chunk, 1 + STRESS_Random(STRESS_CHUNK));
+		}
+		
+		if (length == 0)
+		{
+			
+			INT_Disable();
+			printf("ringbuf_stress: woken with no data at byte %u\n", consumed);
+			exit(1);
+			
+		}
+		
+		uint32_t i;
+		for (i = 0; i < length; i++)
+		{
+			
+			if (chunk[i] != STRESS_Byte(consumed + i))
+			{
+				
+				INT_Disable();
+				printf("ringbuf_stress: byte %u is %u, expected %u\n", consumed + i, chunk[i], STRESS_Byte(consumed + i));
+				exit(1);
+				
+			}
+			
+		}
+		
+		consumed += length;
+		
+	}
+	
+	CHECK(produced == STRESS_BYTES);
+	CHECK(RINGBUF_Count(&rb) == 0);
+	CHECK(waits > 0);
+	CHECK_PASS("ringbuf_stress");
+	
+}
+
+/* xorshift, shared by the tick and the task, any interleaving will do */
+static uint32_t STRESS_Random(uint32_t range)
+{
+	
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	
+	return seed % range;
+	
+}
+
+/* the stream, not periodic in 256 so a lost or repeated lap shows up too */
+static uint8_t STRESS_Byte(uint32_t n)
+{
+	
+	return (uint8_t)(n ^ (n >> 8));
+	
+}
\ No newline at end of file
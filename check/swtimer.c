@@ -0,0 +1,87 @@
+#include "check.h"
+
+#include "swtimer.h"
+
+/*
+ * SWTIMER_NextTick, which bounds tickless sleep: it gives the ticks until
+ * the earliest timer on any wheel level comes due, not just until the next
+ * level 0 wrap, and follows timers being stopped and firing.
+ */
+
+/* variables */
+static volatile uint32_t fired[3];
+static swtimer_t timers[3];
+SCHEDULER_TASK_DEFINE(check_task, TASK_STACK_SIZE);
+
+/* prototypes */
+static void CHECK_Task();
+static void CHECK_Callback(void *arg);
+static uint32_t CHECK_NextTick();
+
+/* functions */
+int main()
+{
+	
+	SCHEDULER_Init();
+	
+	SCHEDULER_TaskInit(&check_task, CHECK_Task, CHECK_PRIORITY);
+	SCHEDULER_Run();
+	
+	return 0;
+	
+}
+
+static void CHECK_Task()
+{
+	
+	CHECK(SWTIMER_Init(CHECK_PRIORITY - 1));
+	CHECK(CHECK_NextTick() == UINT32_MAX);
+	
+	uint32_t i;
+	for (i = 0; i < 3; i++)
+	{
+		SWTIMER_Create(&timers[i], CHECK_Callback, (void*)&fired[i]);
+	}
+	
+	// a tick may pass between starting a timer and asking, hence the ranges
+	SWTIMER_Start(&timers[0], 5000, 0);
+	CHECK(CHECK_NextTick() <= 5000 && CHECK_NextTick() >= 4998);
+	
+	SWTIMER_Start(&timers[1], 100, 0);
+	CHECK(CHECK_NextTick() <= 100 && CHECK_NextTick() >= 98);
+	
+	SWTIMER_Start(&timers[2], 10, 0);
+	CHECK(CHECK_NextTick() <= 10 && CHECK_NextTick() >= 8);
+	
+	SWTIMER_Stop(&timers[2]);
+	CHECK(CHECK_NextTick() <= 100 && CHECK_NextTick() >= 98);
+	
+	SCHEDULER_Sleep(150);
+	
+	CHECK(fired[1] == 1 && fired[0] == 0 && fired[2] == 0);
+	CHECK(CHECK_NextTick() <= 4850 && CHECK_NextTick() >= 4840);
+	
+	SWTIMER_Stop(&timers[0]);
+	CHECK(CHECK_NextTick() == UINT32_MAX);
+	
+	CHECK_PASS("swtimer");
+	
+}
+
+static void CHECK_Callback(void *arg)
+{
+	
+	(*(volatile uint32_t*)arg)++;
+	
+}
+
+static uint32_t CHECK_NextTick()
+{
+	
+	INT_Disable();
+	uint32_t ticks = SWTIMER_NextTick();
+	INT_Enable();
+	
+	return ticks;
+	
+}
\ No newline at end of file
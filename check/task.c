@@ -0,0 +1,130 @@
+#include "check.h"
+
+#define CHECK_ROUNDS 		50 // spawn rounds, each takes the whole pool
+
+/*
+ * Task lifetime: joining with a timeout, deleting blocked tasks, refusing
+ * the exit of a task that still holds a mutex, and SCHEDULER_TaskSpawn
+ * filling and reusing the stack pool far beyond TASK_POOL_SIZE tasks.
+ */
+
+/* variables */
+static mutex_t held;
+static semaphore_t never;
+static volatile uint32_t work = 0;
+SCHEDULER_TASK_DEFINE(sleeper_task, TASK_STACK_SIZE);
+SCHEDULER_TASK_DEFINE(waiter_task, TASK_STACK_SIZE);
+SCHEDULER_TASK_DEFINE(holder_task, TASK_STACK_SIZE);
+SCHEDULER_TASK_DEFINE(check_task, TASK_STACK_SIZE);
+
+/* prototypes */
+static void CHECK_Task();
+static void CHECK_Sleeper();
+static void CHECK_Waiter();
+static void CHECK_Holder();
+static void CHECK_Worker();
+
+/* functions */
+int main()
+{
+	
+	SCHEDULER_Init();
+	SCHEDULER_MutexInit(&held);
+	SCHEDULER_SemInit(&never, 0);
+	
+	SCHEDULER_TaskInit(&check_task, CHECK_Task, CHECK_PRIORITY);
+	SCHEDULER_Run();
+	
+	return 0;
+	
+}
+
+static void CHECK_Task()
+{
+	
+	// joins time out on a running task and succeed once it is deleted
+	CHECK(SCHEDULER_TaskInit(&sleeper_task, CHECK_Sleeper, 2));
+	CHECK(SCHEDULER_TaskInit(&waiter_task, CHECK_Waiter, 2));
+	
+	uint32_t start = SCHEDULER_GetTicks();
+	CHECK(!SCHEDULER_TaskJoin(&sleeper_task, 3));
+	CHECK(SCHEDULER_GetTicks() - start >= 3);
+	CHECK(!SCHEDULER_TaskJoin(&check_task, WAIT_FOREVER));
+	
+	CHECK(SCHEDULER_TaskDelete(&sleeper_task));
+	CHECK(SCHEDULER_TaskDelete(&waiter_task));
+	CHECK(SCHEDULER_TaskJoin(&sleeper_task, 1));
+	CHECK(SCHEDULER_TaskJoin(&waiter_task, 1));
+	CHECK(!SCHEDULER_TaskDelete(&waiter_task));
+	
+	// a deleted waiter no longer takes what is given
+	SCHEDULER_SemGive(&never);
+	CHECK(SCHEDULER_SemTryTake(&never));
+	
+	// a task returning with a mutex held keeps its slot and the mutex
+	CHECK(SCHEDULER_TaskInit(&holder_task, CHECK_Holder, 2));
+	CHECK(!SCHEDULER_TaskJoin(&holder_task, 3));
+	CHECK(!SCHEDULER_TaskDelete(&holder_task));
+	CHECK(!SCHEDULER_MutexTryLock(&held));
+	
+	// spawn the pool full, one more is refused, join them all, again and again
+	uint32_t round;
+	for (round = 0; round < CHECK_ROUNDS; round++)
+	{
+		
+		task_t *spawned[TASK_POOL_SIZE];
+		
+		uint32_t i;
+		for (i = 0; i < TASK_POOL_SIZE; i++)
+		{
+			spawned[i] = SCHEDULER_TaskSpawn(CHECK_Worker, 1 + (i % 3));
+			CHECK(spawned[i]);
+		}
+		
+		CHECK(!SCHEDULER_TaskSpawn(CHECK_Worker, 1));
+		
+		for (i = 0; i < TASK_POOL_SIZE; i++)
+		{
+			CHECK(SCHEDULER_TaskJoin(spawned[i], WAIT_FOREVER));
+		}
+		
+	}
+	
+	CHECK(work == CHECK_ROUNDS * TASK_POOL_SIZE);
+	
+	CHECK_PASS("task");
+	
+}
+
+static void CHECK_Sleeper()
+{
+	
+	SCHEDULER_Sleep(WAIT_FOREVER - 1);
+	
+}
+
+static void CHECK_Waiter()
+{
+	
+	SCHEDULER_SemTake(&never);
+	CHECK(0);
+	
+}
+
+static void CHECK_Holder()
+{
+	
+	SCHEDULER_MutexLock(&held);
+	
+}
+
+static void CHECK_Worker()
+{
+	
+	SCHEDULER_Yield();
+	
+	INT_Disable();
+	work++;
+	INT_Enable();
+	
+}
\ No newline at end of file
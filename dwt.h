@@ -0,0 +1,54 @@
+#ifndef __DWT_H__
+#define __DWT_H__
+
+#include <stdint.h>
+
+#include "efm32.h"
+
+#ifdef SCHEDULER_HOSTED
+#include <time.h>
+
+/* host monotonic time scaled to cycles of a SystemCoreClock core */
+static __INLINE void DWT_Enable()
+{
+	
+}
+
+static __INLINE uint32_t DWT_CycleCount()
+{
+	
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	return (uint32_t)((((uint64_t)now.tv_sec * 1000000000 + now.tv_nsec) * (SystemCoreClock / 1000000)) / 1000);
+	
+}
+
+#else
+/*
+ * Cycle counter of the Cortex-M3 DWT unit. This CMSIS version has no DWT
+ * definitions, so the two registers needed are mapped here.
+ */
+#define DWT_CTRL 						(*(volatile uint32_t*)0xE0001000)
+#define DWT_CYCCNT 					(*(volatile uint32_t*)0xE0001004)
+#define DWT_CTRL_CYCCNTENA 	0x00000001
+
+static __INLINE void DWT_Enable()
+{
+	
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT_CYCCNT = 0;
+	DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+	
+}
+
+static __INLINE uint32_t DWT_CycleCount()
+{
+	
+	return DWT_CYCCNT;
+	
+}
+
+#endif
+
+#endif
\ No newline at end of file
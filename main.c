@@ -34,7 +34,7 @@ int main()
 	// init LEDs
 	LED_Init();
 	
-	// init scheduler
+	// init scheduler, also starts the SCHEDULER_TASK_STATIC tasks
 	SCHEDULER_Init();
 	
 	// enable timers
@@ -43,9 +43,6 @@ int main()
 	// enable interrupts
 	enableInterrupts();
 	
-	// init tasks
-	SCHEDULER_TaskInit(&radio_task, radio_task_entrypoint);
-	
 	// run
 	SCHEDULER_Run();
 	
@@ -0,0 +1,33 @@
+#ifndef __PORT_H__
+#define __PORT_H__
+
+#include <stdint.h>
+
+#include "scheduler.h"
+
+#if defined(SCHEDULER_HOSTED) && (defined(SCHEDULER_TICKLESS) || defined(SCHEDULER_MPU_GUARD) || defined(SCHEDULER_TRACE))
+#error "SCHEDULER_TICKLESS, SCHEDULER_MPU_GUARD and SCHEDULER_TRACE need the target"
+#endif
+
+/*
+ * What scheduler.c needs from the CPU. port_cm3.c implements it for the
+ * Cortex-M3, posix/port_posix.c for the hosted Linux build
+ * (SCHEDULER_HOSTED). A saved context is an opaque pointer: the stack
+ * pointer after the registers were pushed on the target, a ucontext on the
+ * host.
+ */
+
+// sets up the tick and the switch interrupt, called with interrupts disabled
+void PORT_Init();
+// builds the first context of a task returning to exit_point, 0 if the stack is too small
+void *PORT_StackInit(task_t *task, void *entry_point, void *exit_point);
+// requests a switch, taken once interrupts are enabled and no other handler runs
+void PORT_PendSwitch();
+// waits for the next interrupt
+void PORT_Idle();
+
+// provided by scheduler.c, entry_cycles is DWT_CycleCount() as the port's switch began
+void *SCHEDULER_Switch(void *context, uint32_t entry_cycles);
+void SysTick_Handler();
+
+#endif
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include "port.h"
+
+#include "efm32.h"
+
+/* exception frame stacked by the core on entry to PendSV */
+typedef struct 
+{
+	
+	uint32_t r0;
+	uint32_t r1;
+	uint32_t r2;
+	uint32_t r3;
+	uint32_t r12;
+	uint32_t lr;
+	uint32_t pc;
+	uint32_t psr;
+	
+} hw_stack_frame_t;
+
+/* registers PendSV_Handler pushes below it */
+typedef struct 
+{
+
+	uint32_t r4;
+	uint32_t r5;
+	uint32_t r6;
+	uint32_t r7;
+	uint32_t r8;
+	uint32_t r9;
+	uint32_t r10;
+	uint32_t r11;
+	
+} sw_stack_frame_t;
+
+/* functions */
+void PORT_Init()
+{
+	
+	SysTick_Config(TASK_DURATION); // ~ 10ms
+	
+	// switch at the lowest priority so peripheral interrupts can preempt it
+	NVIC_SetPriority(PendSV_IRQn, (1 << __NVIC_PRIO_BITS) - 1);
+	
+	// a zero PSP tells PendSV there is no task context to save yet
+	__set_PSP(0);
+	
+}
+
+/*
+ * Lays out the frames PendSV_Handler expects at the 8-byte aligned top of the
+ * task's stack, so its first switch in "returns" to entry_point.
+ */
+void *PORT_StackInit(task_t *task, void *entry_point, void *exit_point)
+{
+	
+	if (task->stack_size < sizeof(hw_stack_frame_t) + sizeof(sw_stack_frame_t))
+	{
+		return 0;
+	}
+	
+	uint32_t top = (((uint32_t)task->stack_start) + task->stack_size) & ~7;
+	sw_stack_frame_t *saved_frame = (sw_stack_frame_t*)(top - sizeof(hw_stack_frame_t) - sizeof(sw_stack_frame_t));
+	
+	hw_stack_frame_t *process_frame = (hw_stack_frame_t*)(saved_frame + 1);
+	
+	// whole-struct stores, the compiler writes these as block stores
+	*saved_frame = (sw_stack_frame_t){ 0 };
+	*process_frame = (hw_stack_frame_t){ .lr = (uint32_t)exit_point, .pc = (uint32_t)entry_point, .psr = 0x21000000 };
+	
+	return saved_frame;
+	
+}
+
+void PORT_PendSwitch()
+{
+	
+	SCB->ICSR |= (1 << 28);
+	
+}
+
+void PORT_Idle()
+{
+	
+	__WFI();
+	
+}
+
+#ifdef SCHEDULER_INSTRUMENT
+// DWT_CYCCNT into r1, SCHEDULER_Switch's entry_cycles
+#define PORT_SWITCH_STAMP \
+		"MOVW r1, #0x1004\n\t" \
+		"MOVT r1, #0xE000\n\t" \
+		"LDR r1, [r1]\n\t"
+#else
+#define PORT_SWITCH_STAMP
+#endif
+
+/*
+ * The only context switch. r4-r11 go onto the outgoing task's process stack
+ * and only the resulting stack pointer is kept in the TCB; being naked, no
+ * compiler prologue touches the registers before they are saved, whatever
+ * the optimization level. With SCHEDULER_INSTRUMENT the cycle count is
+ * taken first, so the switch histogram includes the register save.
+ */
+__attribute__((naked)) void PendSV_Handler()
+{
+	
+	__asm volatile (
+		PORT_SWITCH_STAMP
+		"CPSID i\n\t"
+		"MRS r0, PSP\n\t"
+		"CBZ r0, 1f\n\t"
+		"STMDB r0!, {r4-r11}\n\t"
+		"1:\n\t"
+		"BL SCHEDULER_Switch\n\t"
+		"LDMIA r0!, {r4-r11}\n\t"
+		"MSR PSP, r0\n\t"
+		"CPSIE i\n\t"
+		"MOV lr, #0xFFFFFFFD\n\t"
+		"BX lr\n\t"
+	);
+	
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef __EFM32_H
+#define __EFM32_H
+
+#include <stdint.h>
+#include <unistd.h>
+
+/*
+ * Stand-in for the device header in the hosted build: the core intrinsics
+ * the kernel, ringbuf.c and swtimer.c use. Exclusive accesses are emulated
+ * with a one-address monitor that port_posix.c clears on every tick and
+ * switch, as exception entry does on the target.
+ */
+
+#define __INLINE 		inline
+
+extern uint32_t SystemCoreClock; // nominal, scales host time to target cycles
+extern volatile uint32_t *port_exclusive;
+extern volatile uint32_t port_in_isr;
+
+uint32_t __STREXW(uint32_t value, volatile uint32_t *addr);
+
+static __INLINE uint32_t __CLZ(uint32_t value)
+{
+	
+	return value ? __builtin_clz(value) : 32;
+	
+}
+
+static __INLINE uint32_t __RBIT(uint32_t value)
+{
+	
+	value = ((value >> 1) & 0x55555555) | ((value & 0x55555555) << 1);
+	value = ((value >> 2) & 0x33333333) | ((value & 0x33333333) << 2);
+	value = ((value >> 4) & 0x0F0F0F0F) | ((value & 0x0F0F0F0F) << 4);
+	
+	return __builtin_bswap32(value);
+	
+}
+
+static __INLINE uint32_t __LDREXW(volatile uint32_t *addr)
+{
+	
+	port_exclusive = addr;
+	
+	return *addr;
+	
+}
+
+static __INLINE void __CLREX()
+{
+	
+	port_exclusive = 0;
+	
+}
+
+static __INLINE void __DMB()
+{
+	
+	__sync_synchronize();
+	
+}
+
+// SysTick's exception number while the tick runs, as on the target
+static __INLINE uint32_t __get_IPSR()
+{
+	
+	return port_in_isr ? 15 : 0;
+	
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,42 @@
+#ifndef __EFM32_INT_H
+#define __EFM32_INT_H
+
+#include <stdint.h>
+
+/*
+ * Hosted INT_Disable/INT_Enable. The tick signal is never blocked; while
+ * INT_LockCnt is non-zero the handler only marks the tick pending, and it and
+ * any pending switch are run once the count drops back to zero.
+ */
+
+extern volatile uint32_t INT_LockCnt;
+
+void PORT_Service();
+
+static inline uint32_t INT_Disable()
+{
+	
+	INT_LockCnt++;
+	
+	return INT_LockCnt;
+	
+}
+
+static inline uint32_t INT_Enable()
+{
+	
+	if (INT_LockCnt == 0)
+	{
+		return 0;
+	}
+	
+	if (--INT_LockCnt == 0)
+	{
+		PORT_Service();
+	}
+	
+	return INT_LockCnt;
+	
+}
+
+#endif
\ No newline at end of file
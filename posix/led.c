@@ -0,0 +1,41 @@
+#include "led.h"
+
+#include <stdio.h>
+
+#include "efm32_int.h"
+
+/* hosted LEDs, state changes are printed instead */
+
+static const char *names[3] = { "red", "blue", "green" };
+static uint8_t state[3];
+
+static void LED_Set(LED led, uint8_t on)
+{
+	
+	INT_Disable();
+	state[led] = on;
+	printf("LED %s %s\n", names[led], on ? "on" : "off");
+	fflush(stdout);
+	INT_Enable();
+	
+}
+
+void LED_Init()
+{
+	
+}
+
+void LED_On(LED led)
+{
+	LED_Set(led, 1);
+}
+
+void LED_Off(LED led)
+{
+	LED_Set(led, 0);
+}
+
+void LED_Toggle(LED led)
+{
+	LED_Set(led, !state[led]);
+}
\ No newline at end of file
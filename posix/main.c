@@ -0,0 +1,23 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "scheduler.h"
+#include "tasks.h"
+#include "led.h"
+
+/* hosted counterpart of main.c, no clocks or peripherals to bring up */
+int main()
+{
+	
+	// init LEDs
+	LED_Init();
+	
+	// init scheduler, also starts the SCHEDULER_TASK_STATIC tasks
+	SCHEDULER_Init();
+	
+	// run
+	SCHEDULER_Run();
+	
+	return 0;
+	
+}
\ No newline at end of file
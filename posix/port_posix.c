@@ -0,0 +1,222 @@
+#include <signal.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <errno.h>
+
+#include "port.h"
+
+#include "efm32.h"
+#include "efm32_int.h"
+#ifdef SCHEDULER_INSTRUMENT
+#include "dwt.h"
+#endif
+
+#define PORT_STACK_MIN 	16384 // room for a signal frame on top of the task's own use
+
+/*
+ * Hosted port: each task runs on its own stack in a ucontext and SIGALRM
+ * from an interval timer stands in for SysTick. Everything still runs on one
+ * OS thread, so masking interrupts is only a counter (see efm32_int.h). The
+ * tick handler switches tasks from inside the signal handler; the frame it
+ * leaves on the preempted task's stack is unwound once that task is resumed.
+ *
+ * libc is not reentrant across such a switch: tasks that call it (printf in
+ * particular) should do so between INT_Disable and INT_Enable.
+ */
+
+typedef struct
+{
+	
+	ucontext_t context;
+	void (*entry_point)();
+	void (*exit_point)();
+	
+} port_frame_t;
+
+/* variables */
+uint32_t SystemCoreClock = 48000000;
+volatile uint32_t INT_LockCnt = 0;
+volatile uint32_t *port_exclusive = 0;
+volatile uint32_t port_in_isr = 0;
+static volatile uint32_t tick_pending = 0;
+static volatile uint32_t switch_pending = 0;
+static port_frame_t *running = 0; // 0 until the first switch out of main
+static ucontext_t main_context;
+
+/* prototypes */
+static void PORT_Tick(int signal);
+static void PORT_TaskStart();
+static void PORT_Switch();
+
+/* functions */
+void PORT_Init()
+{
+	
+	struct sigaction action;
+	action.sa_handler = PORT_Tick;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGALRM, &action, 0);
+	
+	// one tick is TASK_DURATION cycles of a SystemCoreClock core
+	struct itimerval timer;
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = TASK_DURATION / (SystemCoreClock / 1000000);
+	timer.it_value = timer.it_interval;
+	setitimer(ITIMER_REAL, &timer, 0);
+	
+}
+
+/* the context sits at the top of the task's stack, the rest is its stack */
+void *PORT_StackInit(task_t *task, void *entry_point, void *exit_point)
+{
+	
+	if (task->stack_size < PORT_STACK_MIN)
+	{
+		return 0;
+	}
+	
+	uintptr_t top = ((uintptr_t)task->stack_start + task->stack_size - sizeof(port_frame_t)) & ~(uintptr_t)15;
+	port_frame_t *frame = (port_frame_t*)top;
+	
+	getcontext(&frame->context);
+	frame->context.uc_stack.ss_sp = task->stack_start;
+	frame->context.uc_stack.ss_size = top - (uintptr_t)task->stack_start;
+	frame->context.uc_link = 0;
+	sigemptyset(&frame->context.uc_sigmask);
+	frame->entry_point = (void (*)())entry_point;
+	frame->exit_point = (void (*)())exit_point;
+	makecontext(&frame->context, PORT_TaskStart, 0);
+	
+	return frame;
+	
+}
+
+void PORT_PendSwitch()
+{
+	
+	switch_pending = 1;
+	
+	if (!INT_LockCnt)
+	{
+		PORT_Service();
+	}
+	
+}
+
+void PORT_Idle()
+{
+	
+	pause();
+	
+}
+
+/* succeeds only if no tick or switch came since the matching __LDREXW */
+uint32_t __STREXW(uint32_t value, volatile uint32_t *addr)
+{
+	
+	INT_Disable();
+	
+	uint32_t failed = (port_exclusive != addr);
+	
+	if (!failed)
+	{
+		*addr = value;
+	}
+	
+	port_exclusive = 0;
+	
+	INT_Enable();
+	
+	return failed;
+	
+}
+
+/*
+ * Runs the tick and switch requested while interrupts were masked, like the
+ * pended exceptions firing on the target once they are unmasked. Called with
+ * INT_LockCnt at zero; the count is held at one across the tick and the
+ * switch so neither runs nested.
+ */
+void PORT_Service()
+{
+	
+	while (tick_pending || switch_pending)
+	{
+		
+		INT_LockCnt = 1;
+		port_exclusive = 0;
+		
+		if (tick_pending)
+		{
+			
+			tick_pending = 0;
+			port_in_isr = 1;
+			SysTick_Handler();
+			port_in_isr = 0;
+			
+		}
+		
+		if (switch_pending)
+		{
+			
+			switch_pending = 0;
+			PORT_Switch();
+			
+		}
+		
+		INT_LockCnt = 0;
+		
+	}
+	
+}
+
+static void PORT_Tick(int signal)
+{
+	
+	tick_pending = 1;
+	
+	if (!INT_LockCnt)
+	{
+		
+		int saved_errno = errno;
+		PORT_Service();
+		errno = saved_errno;
+		
+	}
+	
+}
+
+/* first code a new task runs, leaves the switch that started it */
+static void PORT_TaskStart()
+{
+	
+	INT_LockCnt = 0;
+	PORT_Service();
+	
+	running->entry_point();
+	running->exit_point();
+	
+}
+
+static void PORT_Switch()
+{
+	
+#ifdef SCHEDULER_INSTRUMENT
+	uint32_t start = DWT_CycleCount();
+#else
+	uint32_t start = 0;
+#endif
+	port_frame_t *from = running;
+	port_frame_t *to = SCHEDULER_Switch(from, start);
+	
+	if (to == from)
+	{
+		return;
+	}
+	
+	running = to;
+	swapcontext(from ? &from->context : &main_context, &to->context);
+	
+}
\ No newline at end of file
@@ -0,0 +1,238 @@
+#include "proto.h"
+
+#include "efm32.h"
+#include "efm32_int.h"
+
+#include "scheduler.h"
+
+/* variables */
+static proto_t *protos[PROTO_MAX];
+static uint32_t used = 0; // bit n set = protos[n] started
+static volatile uint32_t ready = 0; // bit n set = protos[n] due to run
+static uint32_t sleeping = 0; // bit n set = protos[n] waits for its wake_tick
+static uint32_t waiting = 0; // bit n set = protos[n] waits for a signal
+static uint32_t last = PROTO_MAX - 1; // protothread dispatched last
+SCHEDULER_TASK_DEFINE(proto_task, PROTO_STACK_SIZE);
+static event_t proto_event;
+
+/* prototypes */
+static void PROTO_Task();
+static uint32_t PROTO_Wakeups(uint32_t now);
+
+/*
+ * Stackless run-to-completion tasks. Every protothread is a function that
+ * runs until it has to wait and then returns, so all of them share the stack
+ * of one dispatcher task and cost a proto_t each instead of a stack and a
+ * TCB. The dispatcher is an ordinary task at the priority given to
+ * PROTO_Init: preemptive tasks above it preempt whichever protothread is
+ * running, the ones below only run once every protothread is waiting.
+ * Ready protothreads are dispatched round-robin by slot.
+ */
+
+/* functions */
+bool PROTO_Init(uint32_t priority)
+{
+	
+	uint32_t i;
+	for (i = 0; i < PROTO_MAX; i++)
+	{
+		protos[i] = 0;
+	}
+	
+	used = 0;
+	ready = 0;
+	sleeping = 0;
+	waiting = 0;
+	last = PROTO_MAX - 1;
+	SCHEDULER_EventInit(&proto_event);
+	
+	return SCHEDULER_TaskInit(&proto_task, PROTO_Task, priority);
+	
+}
+
+/*
+ * Takes the first free slot and makes the protothread ready to run from
+ * the top of fn. Returns false if all PROTO_MAX slots are taken.
+ */
+bool PROTO_Start(proto_t *pt, proto_fn_t fn, void *arg)
+{
+	
+	INT_Disable();
+	
+	if (used == 0xFFFFFFFF)
+	{
+		INT_Enable();
+		return false;
+	}
+	
+	uint32_t id = __CLZ(__RBIT(~used));
+	
+	pt->line = 0;
+	pt->fn = fn;
+	pt->arg = arg;
+	pt->id = id;
+	pt->signals = 0;
+	protos[id] = pt;
+	used |= (1 << id);
+	ready |= (1 << id);
+	SCHEDULER_EventSignal(&proto_event, 1);
+	
+	INT_Enable();
+	
+	return true;
+	
+}
+
+/*
+ * Posts signal bits to a protothread and readies it if it is waiting. Safe
+ * to call from interrupts.
+ */
+void PROTO_Signal(proto_t *pt, uint32_t bits)
+{
+	
+	INT_Disable();
+	
+	pt->signals |= bits;
+	
+	if (pt->id != PROTO_NONE && (waiting & (1 << pt->id)))
+	{
+		
+		waiting &= ~(1 << pt->id);
+		ready |= (1 << pt->id);
+		SCHEDULER_EventSignal(&proto_event, 1);
+		
+	}
+	
+	INT_Enable();
+	
+}
+
+/* returns and clears the signals posted so far */
+uint32_t PROTO_TakeSignals(proto_t *pt)
+{
+	
+	INT_Disable();
+	
+	uint32_t bits = pt->signals;
+	pt->signals = 0;
+	
+	INT_Enable();
+	
+	return bits;
+	
+}
+
+/*
+ * The dispatcher: runs the next ready protothread after the last one to its
+ * next wait, files it by what it returned, and blocks until a signal or the
+ * next wake tick once nothing is ready.
+ */
+static void PROTO_Task()
+{
+	
+	while (1)
+	{
+		
+		INT_Disable();
+		
+		uint32_t timeout = PROTO_Wakeups(SCHEDULER_GetTicks());
+		
+		if (!ready)
+		{
+			
+			SCHEDULER_EventWaitTimeout(&proto_event, 1, timeout);
+			INT_Enable();
+			continue;
+			
+		}
+		
+		// search from the slot after the last one, as SCHEDULER_NextTask does
+		uint32_t pick = ready;
+		uint32_t after = pick & ~((2UL << last) - 1);
+		
+		if (after)
+		{
+			pick = after;
+		}
+		
+		uint32_t id = __CLZ(__RBIT(pick));
+		proto_t *pt = protos[id];
+		ready &= ~(1 << id);
+		last = id;
+		
+		INT_Enable();
+		
+		uint32_t state = pt->fn(pt);
+		
+		INT_Disable();
+		
+		switch (state)
+		{
+			
+			case PROTO_YIELDED:
+				ready |= (1 << id);
+				break;
+			
+			case PROTO_SLEEPING:
+				sleeping |= (1 << id);
+				break;
+			
+			case PROTO_WAITING:
+				// signalled while it ran, so it has to look again
+				if (pt->signals)
+				{
+					ready |= (1 << id);
+				}
+				else
+				{
+					waiting |= (1 << id);
+				}
+				break;
+			
+			default:
+				pt->id = PROTO_NONE;
+				protos[id] = 0;
+				used &= ~(1 << id);
+				break;
+			
+		}
+		
+		INT_Enable();
+		
+	}
+	
+}
+
+/*
+ * Readies the sleepers whose wake tick has come and returns the ticks until
+ * the next one is due, WAIT_FOREVER if none sleep. Must be called with
+ * interrupts disabled.
+ */
+static uint32_t PROTO_Wakeups(uint32_t now)
+{
+	
+	uint32_t timeout = WAIT_FOREVER;
+	uint32_t pending = sleeping;
+	
+	while (pending)
+	{
+		
+		uint32_t id = __CLZ(__RBIT(pending));
+		int32_t ticks = (int32_t)(protos[id]->wake_tick - now);
+		pending &= ~(1 << id);
+		
+		if (ticks <= 0)
+		{
+			sleeping &= ~(1 << id);
+			ready |= (1 << id);
+		}
+		else if ((uint32_t)ticks < timeout)
+		{
+			timeout = ticks;
+		}
+		
+	}
+	
+	return timeout;
+	
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#ifndef __PROTO_H__
+#define __PROTO_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "scheduler.h"
+
+#define PROTO_MAX 				32 // protothreads per dispatcher
+#ifdef SCHEDULER_HOSTED
+#define PROTO_STACK_SIZE 	65536
+#else
+#define PROTO_STACK_SIZE 	1024 // the one stack every protothread runs on
+#endif
+#define PROTO_NONE 			PROTO_MAX // not started or exited
+
+// what a protothread's function returns to the dispatcher, set by the macros below
+#define PROTO_WAITING 			0 // run again once signalled
+#define PROTO_YIELDED 			1 // run again after the other ready ones
+#define PROTO_SLEEPING 		2 // run again at wake_tick
+#define PROTO_EXITED 			3
+
+struct proto;
+
+typedef uint32_t (*proto_fn_t)(struct proto *pt);
+
+typedef struct proto
+{
+	
+	uint32_t line; // where to resume, 0 = from the top
+	proto_fn_t fn;
+	void *arg;
+	uint32_t id; // dispatcher slot, PROTO_NONE when not running
+	uint32_t wake_tick;
+	volatile uint32_t signals; // posted by PROTO_Signal, not yet taken
+	
+} proto_t;
+
+/*
+ * Protothread bodies are a switch on pt->line, so locals do not survive a
+ * wait and the macros must not be used inside another switch. Keep state in
+ * statics or in a struct reached through pt->arg.
+ */
+#define PROTO_BEGIN(pt) 					switch ((pt)->line) { case 0:
+#define PROTO_END(pt) 						} (pt)->line = 0; return PROTO_EXITED
+#define PROTO_RESUME(pt, state) 			do { (pt)->line = __LINE__; return (state); case __LINE__:; } while (0)
+#define PROTO_YIELD(pt) 					PROTO_RESUME(pt, PROTO_YIELDED)
+#define PROTO_SLEEP(pt, ticks) 			do { (pt)->wake_tick = SCHEDULER_GetTicks() + (ticks); PROTO_RESUME(pt, PROTO_SLEEPING); } while (0)
+// cond is only checked again after the protothread has been signalled
+#define PROTO_WAIT_UNTIL(pt, cond) 		do { (pt)->line = __LINE__; case __LINE__: if (!(cond)) return PROTO_WAITING; } while (0)
+#define PROTO_WAIT_SIGNAL(pt, bits) 		PROTO_WAIT_UNTIL(pt, ((bits) = PROTO_TakeSignals(pt)) != 0)
+#define PROTO_EXIT(pt) 					do { (pt)->line = 0; return PROTO_EXITED; } while (0)
+
+bool PROTO_Init(uint32_t priority);
+bool PROTO_Start(proto_t *pt, proto_fn_t fn, void *arg);
+void PROTO_Signal(proto_t *pt, uint32_t bits);
+uint32_t PROTO_TakeSignals(proto_t *pt);
+
+#endif
\ No newline at end of file
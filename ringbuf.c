@@ -0,0 +1,206 @@
+#include "ringbuf.h"
+
+#include "efm32.h"
+#include "efm32_int.h"
+
+#include <string.h>
+
+/*
+ * Single-producer/single-consumer byte ring, e.g. an RX interrupt feeding a
+ * task. head and tail run freely and are masked on access; each side only
+ * ever writes its own index, and a barrier orders the data copy before the
+ * index update, so neither side needs locks or interrupt masking.
+ */
+
+/* prototypes */
+static void RINGBUF_Publish(ringbuf_t *rb, uint32_t head);
+
+/* functions */
+bool RINGBUF_Init(ringbuf_t *rb, void *buffer, uint32_t size, bool wake)
+{
+	
+	if (size == 0 || (size & (size - 1)))
+	{
+		return false;
+	}
+	
+	rb->buffer = buffer;
+	rb->mask = size - 1;
+	rb->head = 0;
+	rb->tail = 0;
+	rb->wake = wake;
+	rb->waiting = 0;
+	SCHEDULER_EventInit(&rb->event);
+	
+	return true;
+	
+}
+
+uint32_t RINGBUF_Count(ringbuf_t *rb)
+{
+	
+	return rb->head - rb->tail;
+	
+}
+
+uint32_t RINGBUF_Free(ringbuf_t *rb)
+{
+	
+	return rb->mask + 1 - (rb->head - rb->tail);
+	
+}
+
+/* producer side */
+bool RINGBUF_Put(ringbuf_t *rb, uint8_t byte)
+{
+	
+	uint32_t head = rb->head;
+	
+	if (head - rb->tail > rb->mask)
+	{
+		return false;
+	}
+	
+	rb->buffer[head & rb->mask] = byte;
+	RINGBUF_Publish(rb, head + 1);
+	
+	return true;
+	
+}
+
+/*
+ * Copies up to length bytes in, splitting the copy where the ring wraps, and
+ * returns how many fit.
+ */
+uint32_t RINGBUF_Write(ringbuf_t *rb, const void *data, uint32_t length)
+{
+	
+	uint32_t head = rb->head;
+	uint32_t space = rb->mask + 1 - (head - rb->tail);
+	
+	if (length > space)
+	{
+		length = space;
+	}
+	
+	if (length == 0)
+	{
+		return 0;
+	}
+	
+	uint32_t offset = head & rb->mask;
+	uint32_t first = rb->mask + 1 - offset;
+	
+	if (first > length)
+	{
+		first = length;
+	}
+	
+	memcpy(rb->buffer + offset, data, first);
+	memcpy(rb->buffer, (const uint8_t*)data + first, length - first);
+	
+	RINGBUF_Publish(rb, head + length);
+	
+	return length;
+	
+}
+
+/* consumer side */
+bool RINGBUF_Get(ringbuf_t *rb, uint8_t *byte)
+{
+	
+	uint32_t tail = rb->tail;
+	
+	if (rb->head == tail)
+	{
+		return false;
+	}
+	
+	// read the data only after seeing the producer's head
+	__DMB();
+	*byte = rb->buffer[tail & rb->mask];
+	__DMB();
+	rb->tail = tail + 1;
+	
+	return true;
+	
+}
+
+uint32_t RINGBUF_Read(ringbuf_t *rb, void *data, uint32_t length)
+{
+	
+	uint32_t tail = rb->tail;
+	uint32_t count = rb->head - tail;
+	
+	if (length > count)
+	{
+		length = count;
+	}
+	
+	if (length == 0)
+	{
+		return 0;
+	}
+	
+	__DMB();
+	
+	uint32_t offset = tail & rb->mask;
+	uint32_t first = rb->mask + 1 - offset;
+	
+	if (first > length)
+	{
+		first = length;
+	}
+	
+	memcpy(data, rb->buffer + offset, first);
+	memcpy((uint8_t*)data + first, rb->buffer, length - first);
+	
+	__DMB();
+	rb->tail = tail + length;
+	
+	return length;
+	
+}
+
+/*
+ * Blocks the consumer task until the ring holds data. Only valid on rings
+ * initialised with wake set. The check and the wait are done with interrupts
+ * disabled so a producer interrupt cannot slip its signal in between.
+ */
+void RINGBUF_WaitData(ringbuf_t *rb)
+{
+	
+	INT_Disable();
+	
+	// the producer clears waiting when it signals
+	if (rb->head == rb->tail)
+	{
+		rb->waiting = 1;
+		SCHEDULER_EventWait(&rb->event, 1);
+	}
+	
+	INT_Enable();
+	
+}
+
+/* makes newly written data visible, then wakes the consumer if it sleeps */
+static void RINGBUF_Publish(ringbuf_t *rb, uint32_t head)
+{
+	
+	__DMB();
+	rb->head = head;
+	
+	if (rb->wake)
+	{
+		
+		__DMB();
+		
+		if (rb->waiting)
+		{
+			rb->waiting = 0;
+			SCHEDULER_EventSignal(&rb->event, 1);
+		}
+		
+	}
+	
+}
\ No newline at end of file
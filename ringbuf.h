@@ -0,0 +1,31 @@
+#ifndef __RINGBUF_H__
+#define __RINGBUF_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "scheduler.h"
+
+typedef struct
+{
+
+	uint8_t *buffer;
+	uint32_t mask; // size - 1, size is a power of two
+	volatile uint32_t head; // free running, only written by the producer
+	volatile uint32_t tail; // free running, only written by the consumer
+	bool wake; // signal a consumer blocked in RINGBUF_WaitData
+	volatile uint32_t waiting;
+	event_t event;
+
+} ringbuf_t;
+
+bool RINGBUF_Init(ringbuf_t *rb, void *buffer, uint32_t size, bool wake);
+uint32_t RINGBUF_Count(ringbuf_t *rb);
+uint32_t RINGBUF_Free(ringbuf_t *rb);
+bool RINGBUF_Put(ringbuf_t *rb, uint8_t byte);
+bool RINGBUF_Get(ringbuf_t *rb, uint8_t *byte);
+uint32_t RINGBUF_Write(ringbuf_t *rb, const void *data, uint32_t length);
+uint32_t RINGBUF_Read(ringbuf_t *rb, void *data, uint32_t length);
+void RINGBUF_WaitData(ringbuf_t *rb);
+
+#endif
\ No newline at end of file
@@ -1,17 +1,130 @@
 #include "scheduler.h"
+#include "port.h"
 
 #include "efm32.h"
 #include "efm32_int.h"
 
+#ifdef SCHEDULER_SWTIMER
+#include "swtimer.h"
+#endif
+
+#ifdef SCHEDULER_MPU_GUARD
+#include "efm32_mpu.h"
+#endif
+
+#if defined(SCHEDULER_INSTRUMENT) || defined(SCHEDULER_STATS)
+#include "dwt.h"
+#endif
+
+#ifdef SCHEDULER_TRACE
+#include "trace.h"
+#endif
+
+#ifdef SCHEDULER_TICKLESS
+#include "efm32_cmu.h"
+#include "efm32_emu.h"
+#include "efm32_rtc.h"
+#endif
+
 #include <stdbool.h>
 
 /* variables */
-static bool msp_in_use = true;
 static task_table_t task_table[MAX_TASKS];
+static task_state_t task_state[MAX_TASKS];
 static uint32_t current_task = 0;
+static uint32_t slice_left = 1; // ticks left of the running task's quantum
+static volatile uint32_t ready_mask[PRIORITY_LEVELS]; // bit n set = task_table[n] runnable
+static volatile uint32_t priority_mask = 0; // bit p set = ready_mask[p] not empty
+static volatile uint32_t tick_count = 0;
+static uint32_t sleep_head = NO_TASK; // delta list of sleeping tasks
+static event_t flag_event; // backs SCHEDULER_Wait/SCHEDULER_Release
+static event_t exit_event; // joiners wait here for bit n, set when slot n's task ends
+
+#ifdef SCHEDULER_TASK_POOL
+static task_t pool_tasks[TASK_POOL_SIZE];
+static uint32_t pool_stacks[TASK_POOL_SIZE][TASK_POOL_STACK_SIZE / 4] __attribute__((aligned(STACK_ALIGN)));
+static uint32_t pool_used = 0; // bit n set = pool_tasks[n] taken
+#endif
+
+#ifdef SCHEDULER_EDF
+static uint32_t edf_head = NO_TASK; // ready tasks at EDF_PRIORITY, earliest deadline first
+static uint32_t edf_density = 0; // admitted density of all periodic tasks, EDF_SCALE = 1
+#endif
+
+#ifdef SCHEDULER_STATS
+static uint32_t switched_in; // cycle count when the running task was switched in
+static uint64_t busy_cycles; // cycles run by tasks other than idle
+static uint64_t load_window_start; // busy_cycles at the start of the load window
+static uint32_t load_window_tick; // tick_count at the start of the load window
+static volatile uint32_t load_percent;
+#endif
+
+#ifdef SCHEDULER_INSTRUMENT
+static histogram_t switch_cycles; // from the port's switch starting to the next context being returned
+static histogram_t wake_cycles; // from a task being woken to it running
+static uint32_t wake_stamp[MAX_TASKS]; // cycle count at wake, 0 if not pending
+#endif
+static volatile uint32_t idle_ticks = 0;
+
+SCHEDULER_TASK_DEFINE(idle_task, IDLE_STACK_SIZE);
+static uint32_t idle_task_id;
+static idle_hook_t idle_hooks[IDLE_HOOKS_MAX];
+
+// bounds of the SCHEDULER_TASK_STATIC descriptors, weak so a build without any links
+extern const task_descriptor_t __start_scheduler_tasks[] __attribute__((weak));
+extern const task_descriptor_t __stop_scheduler_tasks[] __attribute__((weak));
+static uint32_t idle_hook_count = 0;
+
+#ifdef SCHEDULER_TICKLESS
+static uint32_t tick_hz;
+static uint32_t rtc_hz;
+static uint32_t rtc_remainder = 0; // rtc cycles slept not yet accounted as a tick
+#endif
 
 /* prototypes */
-void SCHEDULER_TaskExit();
+static void SCHEDULER_TaskRelease(uint32_t id);
+static bool SCHEDULER_PriorityValid(uint32_t priority);
+static uint32_t SCHEDULER_TaskCreate(task_t *task, void *entry_point, uint32_t priority);
+static void *SCHEDULER_StackBuild(task_t *task, void *entry_point);
+static void SCHEDULER_TaskFill(uint32_t id, task_t *task, void *context, uint32_t priority);
+static uint32_t SCHEDULER_TaskId(task_t *task);
+static void SCHEDULER_IdleTask();
+static uint32_t SCHEDULER_NextTask();
+static void SCHEDULER_ReadyAdd(uint32_t id);
+static void SCHEDULER_ReadyRemove(uint32_t id);
+static void SCHEDULER_Preempt(uint32_t id);
+static void SCHEDULER_PendSwitch();
+static void SCHEDULER_SleepAdvance(uint32_t ticks);
+static void SCHEDULER_SleepInsert(uint32_t ticks);
+static void SCHEDULER_SleepRemove(uint32_t id);
+static void SCHEDULER_BlockTimeout(uint32_t timeout);
+static void SCHEDULER_Block();
+static void SCHEDULER_Wake(uint32_t id);
+static void SCHEDULER_SetPriority(uint32_t id, uint32_t priority);
+static bool SCHEDULER_Boosted(uint32_t id);
+static void SCHEDULER_Unboost(uint32_t id);
+static void SCHEDULER_Reinherit(uint32_t id);
+static void SCHEDULER_WaitListAdd(event_t *list);
+static void SCHEDULER_WaitListRemove(event_t *list, uint32_t prev, uint32_t id);
+static uint32_t SCHEDULER_WaitListPop(event_t *list);
+static void SCHEDULER_WaitListUnlink(uint32_t id);
+#ifdef SCHEDULER_TICKLESS
+static void SCHEDULER_IdleSleep();
+#endif
+#ifdef SCHEDULER_INSTRUMENT
+static void SCHEDULER_HistogramAdd(histogram_t *histogram, uint32_t cycles);
+#endif
+#ifdef SCHEDULER_EDF
+static void SCHEDULER_DeadlineCheck();
+#endif
+#ifdef SCHEDULER_BUDGET
+static void SCHEDULER_BudgetCharge();
+static void SCHEDULER_BudgetThrottle();
+#endif
+#ifdef SCHEDULER_STATS
+static void SCHEDULER_StatsSwitch(uint32_t previous, bool save);
+static void SCHEDULER_StatsLoad();
+#endif
 
 /* functions */
 void SCHEDULER_Init()
@@ -19,181 +132,2346 @@ void SCHEDULER_Init()
 	
 	INT_Disable();
 	
-	SysTick_Config(TASK_DURATION); // ~ 10ms
+	PORT_Init();
+	
+#if defined(SCHEDULER_INSTRUMENT) || defined(SCHEDULER_STATS)
+	DWT_Enable();
+#endif
+#ifdef SCHEDULER_INSTRUMENT
+	SCHEDULER_InstrumentReset();
+#endif
+#ifdef SCHEDULER_STATS
+	switched_in = DWT_CycleCount();
+	busy_cycles = 0;
+	load_window_start = 0;
+	load_window_tick = 0;
+	load_percent = 0;
+#endif
+	
+#ifdef SCHEDULER_TICKLESS
+	tick_hz = SystemCoreClock / TASK_DURATION;
+	rtc_hz = CMU_ClockFreqGet(cmuClock_RTC);
+	RTC_IntClear(RTC_IF_COMP0);
+	NVIC_ClearPendingIRQ(RTC_IRQn);
+	NVIC_EnableIRQ(RTC_IRQn);
+#endif
 	
 	int i;
 	for (i = 0; i < MAX_TASKS; i++)
 	{
 		task_table[i].flags = 0;
 	}
+	for (i = 0; i < PRIORITY_LEVELS; i++)
+	{
+		ready_mask[i] = 0;
+	}
+	priority_mask = 0;
+	sleep_head = NO_TASK;
+#ifdef SCHEDULER_EDF
+	edf_head = NO_TASK;
+	edf_density = 0;
+#endif
+	SCHEDULER_EventInit(&flag_event);
+	SCHEDULER_EventInit(&exit_event);
+	
+#ifdef SCHEDULER_TASK_POOL
+	pool_used = 0;
+	for (i = 0; i < TASK_POOL_SIZE; i++)
+	{
+		pool_tasks[i].stack_start = pool_stacks[i];
+		pool_tasks[i].stack_size = sizeof(pool_stacks[i]);
+	}
+#endif
+	
+	// the idle task takes the first slot and is always ready, the static
+	// tasks follow in link order, all in one pass without a slot search
+	idle_hook_count = 0;
+	idle_task_id = 0;
+	SCHEDULER_TaskFill(0, &idle_task, SCHEDULER_StackBuild(&idle_task, SCHEDULER_IdleTask), IDLE_PRIORITY);
+	
+#ifndef SCHEDULER_HOSTED
+	// the bound efm32gg.ld checks the section against, in bytes, so the link
+	// fails on too many descriptors with no second copy of MAX_TASKS
+	__asm volatile (".global __scheduler_tasks_max\n\t.set __scheduler_tasks_max, %c0" : : "i" ((MAX_TASKS - 1) * sizeof(task_descriptor_t)));
+#endif
+	
+	// more static tasks than slots left next to the idle task, a build error
+	if (__stop_scheduler_tasks - __start_scheduler_tasks > MAX_TASKS - 1)
+	{
+		while (1);
+	}
+	
+	uint32_t id = 1;
+	const task_descriptor_t *descriptor;
+	for (descriptor = __start_scheduler_tasks; descriptor < __stop_scheduler_tasks; descriptor++)
+	{
+		
+		void *context;
+		
+		if (SCHEDULER_PriorityValid(descriptor->priority) && (context = SCHEDULER_StackBuild(descriptor->task, descriptor->entry_point)))
+		{
+			SCHEDULER_TaskFill(id++, descriptor->task, context, descriptor->priority);
+		}
+		
+	}
+	
+#ifdef SCHEDULER_MPU_GUARD
+	// only the base address changes per switch, the rest is set once here
+	MPU_RegionInit_TypeDef guard =
+	{
+		true, MPU_GUARD_REGION, (uint32_t)idle_task.stack_start, mpuRegionSize32b,
+		mpuRegionNoAccess, true, false, false, false, 0, 0
+	};
+	MPU_ConfigureRegion(&guard);
+	MPU_Enable(MPU_CTRL_PRIVDEFENA);
+#endif
 	
 }
 
 void SCHEDULER_Run()
 {
 	
+	// the idle task picks up from here, main's stack is not used again
+	SCHEDULER_PendSwitch();
 	INT_Enable();
 	while(1);
 	
 }
 
-bool SCHEDULER_TaskInit(task_t *task, void *entry_point)
+bool SCHEDULER_TaskInit(task_t *task, void *entry_point, uint32_t priority)
 {
 	
-	task->stack = (void*)(((uint32_t)task->stack_start) + TASK_STACK_SIZE - sizeof(hw_stack_frame_t));
+	if (!SCHEDULER_PriorityValid(priority))
+	{
+		return false;
+	}
 	
-	hw_stack_frame_t *process_frame = (hw_stack_frame_t*)(task->stack);
-	process_frame->r0 = 0;
-	process_frame->r1 = 0;
-	process_frame->r2 = 0;
-	process_frame->r3 = 0;
-	process_frame->r12 = 0;
-	process_frame->pc = (uint32_t)entry_point;
-	process_frame->lr = (uint32_t)SCHEDULER_TaskExit;
-	process_frame->psr = 0x21000000;
+	return SCHEDULER_TaskCreate(task, entry_point, priority) != NO_TASK;
 	
-	int i;
-	for (i = 0; i < MAX_TASKS; i++)
+}
+
+/* priorities TaskInit and SCHEDULER_TASK_STATIC accept */
+static bool SCHEDULER_PriorityValid(uint32_t priority)
+{
+	
+	if (priority == IDLE_PRIORITY || priority >= PRIORITY_LEVELS)
+	{
+		return false;
+	}
+	
+#ifdef SCHEDULER_EDF
+	if (priority == EDF_PRIORITY)
+	{
+		return false;
+	}
+#endif
+	
+	return true;
+	
+}
+
+#ifdef SCHEDULER_EDF
+/*
+ * Starts a periodic task scheduled earliest deadline first, ahead of all
+ * fixed-priority tasks. Each job may run for up to wcet ticks and has to be
+ * done deadline ticks after its release; releases are period ticks apart.
+ * The task is only admitted while the summed density wcet / min(deadline,
+ * period) of all periodic tasks stays at or below one, which is sufficient
+ * for EDF to meet every deadline.
+ */
+bool SCHEDULER_TaskInitPeriodic(task_t *task, void *entry_point, uint32_t wcet, uint32_t period, uint32_t deadline)
+{
+	
+	if (wcet == 0 || period == 0 || deadline < wcet)
+	{
+		return false;
+	}
+	
+	uint32_t window = deadline < period ? deadline : period;
+	uint32_t density = (uint32_t)(((uint64_t)wcet * EDF_SCALE + window - 1) / window);
+	
+	INT_Disable();
+	
+	if (edf_density + density > EDF_SCALE)
+	{
+		INT_Enable();
+		return false;
+	}
+	
+	// interrupts stay disabled across the create, so nothing runs the new
+	// task before its deadline is set and it is sorted in
+	uint32_t id = SCHEDULER_TaskCreate(task, entry_point, EDF_PRIORITY);
+	
+	if (id == NO_TASK)
+	{
+		INT_Enable();
+		return false;
+	}
+	
+	SCHEDULER_ReadyRemove(id);
+	task_table[id].flags |= PERIODIC_FLAG;
+	task_state[id].period = period;
+	task_state[id].relative_deadline = deadline;
+	task_state[id].density = density;
+	task_state[id].release = tick_count;
+	task_state[id].deadline = tick_count + deadline;
+	task_state[id].missed = false;
+	SCHEDULER_ReadyAdd(id);
+	SCHEDULER_Preempt(id);
+	
+	edf_density += density;
+	
+	INT_Enable();
+	
+	return true;
+	
+}
+
+/*
+ * Ends the calling periodic task's current job, counting a miss if it ran
+ * past its deadline and the tick has not counted it yet, and sleeps until
+ * the next release. A job that ends after the next release has already come
+ * starts the next one at once.
+ */
+void SCHEDULER_WaitNextPeriod()
+{
+	
+	INT_Disable();
+	
+	task_state_t *state = &task_state[current_task];
+	
+	if ((int32_t)(tick_count - (state->release + state->relative_deadline)) > 0 && !state->missed)
+	{
+		state->deadline_misses++;
+	}
+	
+	state->release += state->period;
+	state->missed = false;
+	
+	int32_t ticks = (int32_t)(state->release - tick_count);
+	
+	if (ticks > 0)
 	{
 		
-		if (!(task_table[i].flags & IN_USE_FLAG))
-		{
-			
-			task_table[i].task = task;
-			task_table[i].flags = (IN_USE_FLAG | EXEC_FLAG);
-			
-			return true;
-			
-		}
+		state->deadline = state->release + state->relative_deadline;
+		SCHEDULER_SleepInsert(ticks);
+		SCHEDULER_Block();
+		
+	}
+	else
+	{
+		
+		SCHEDULER_ReadyRemove(current_task);
+		state->deadline = state->release + state->relative_deadline;
+		SCHEDULER_ReadyAdd(current_task);
+		SCHEDULER_PendSwitch();
 		
 	}
 	
-	return false;
+	INT_Enable();
 	
 }
 
-void SCHEDULER_Wait(uint32_t flags)
+/* jobs of a periodic task that were still running when their deadline passed */
+uint32_t SCHEDULER_DeadlineMisses(task_t *task)
 {
 	
-	task_table[current_task].flags |= flags;
-	task_table[current_task].flags &= (~EXEC_FLAG);
-	SCHEDULER_Yield();
+	uint32_t id = SCHEDULER_TaskId(task);
+	
+	return id != NO_TASK ? task_state[id].deadline_misses : 0;
 	
 }
 
-void SCHEDULER_Release(uint32_t flags)
+/*
+ * Counts a miss for every ready job whose deadline the tick has just passed,
+ * so a job that overruns and never completes shows up too. edf_head is sorted
+ * by deadline and an inherited one is never later than the task's own, so
+ * only the front of the list needs looking at. Called from the tick with
+ * interrupts disabled.
+ */
+static void SCHEDULER_DeadlineCheck()
+{
+	
+	uint32_t id;
+	for (id = edf_head; id != NO_TASK && (int32_t)(tick_count - task_state[id].deadline) > 0; id = task_state[id].edf_next)
+	{
+		
+		task_state_t *state = &task_state[id];
+		
+		if ((task_table[id].flags & PERIODIC_FLAG) && !state->missed && (int32_t)(tick_count - (state->release + state->relative_deadline)) > 0)
+		{
+			state->deadline_misses++;
+			state->missed = true;
+		}
+		
+	}
+	
+}
+#endif
+
+/* returns the new task's slot, NO_TASK if it could not be created */
+static uint32_t SCHEDULER_TaskCreate(task_t *task, void *entry_point, uint32_t priority)
 {
 	
+	void *context = SCHEDULER_StackBuild(task, entry_point);
+	
+	if (!context)
+	{
+		return NO_TASK;
+	}
+	
+	INT_Disable();
+	
 	int i;
 	for (i = 0; i < MAX_TASKS; i++)
 	{
 		
-		if (task_table[i].flags & flags)
+		// an exited task keeps its slot until it has been switched away from
+		if (!task_table[i].flags)
 		{
 			
-			task_table[i].flags &= (~flags);
-			task_table[i].flags |= EXEC_FLAG;
+			SCHEDULER_TaskFill(i, task, context, priority);
+			SCHEDULER_Preempt(i);
+			INT_Enable();
+			
+			return i;
 			
 		}
 		
 	}
 	
+	INT_Enable();
+	
+	return NO_TASK;
+	
 }
 
-void SCHEDULER_Yield()
+/* prepares a task's stack, returns its initial context or 0 if it does not fit */
+static void *SCHEDULER_StackBuild(task_t *task, void *entry_point)
 {
 	
-	SCB->ICSR |= (1 << 28);
+#ifdef SCHEDULER_MPU_GUARD
+	if (((uint32_t)task->stack_start) & (MPU_GUARD_SIZE - 1))
+	{
+		return 0;
+	}
+#endif
+	
+	// paint first, the port then writes the initial context over the top
+#if defined(SCHEDULER_STACK_PAINT)
+	uint32_t *word;
+	for (word = task->stack_start; word < task->stack_start + task->stack_size / 4; word++)
+	{
+		*word = STACK_PAINT_WORD;
+	}
+#elif defined(SCHEDULER_STACK_CHECK)
+	task->stack_start[0] = STACK_PAINT_WORD;
+#endif
+	
+	void *context = PORT_StackInit(task, entry_point, SCHEDULER_TaskExit);
+	
+#ifdef SCHEDULER_MPU_GUARD
+	if ((uint8_t*)context < (uint8_t*)task->stack_start + MPU_GUARD_SIZE)
+	{
+		return 0;
+	}
+#endif
+	
+	return context;
 	
 }
 
-void SCHEDULER_TaskExit()
+/* sets up slot id for a ready task. Must be called with interrupts disabled */
+static void SCHEDULER_TaskFill(uint32_t id, task_t *task, void *context, uint32_t priority)
 {
 	
-	task_table[current_task].flags = 0;
-	SCHEDULER_Yield();
-	while(1);
+	task_table[id].stack = context;
+	task_state[id].task = task;
+	task_table[id].flags = (IN_USE_FLAG | EXEC_FLAG);
+	task_table[id].priority = priority;
+	task_state[id].base_priority = priority;
+	task_state[id].mutexes_held = 0;
+	task_state[id].wait_mutex = 0;
+	task_state[id].sleep_next = NO_TASK;
+	task_state[id].wait_next = NO_TASK;
+	task_state[id].wait_list = 0;
+	task_state[id].quantum = DEFAULT_QUANTUM;
+#ifdef SCHEDULER_BUDGET
+	task_state[id].budget = 0;
+	task_state[id].overruns = 0;
+#endif
+#ifdef SCHEDULER_STATS
+	task_state[id].stats = (task_stats_t){ 0 };
+	task_state[id].blocked_at = 0;
+	task_state[id].yielded = 0;
+#endif
+#ifdef SCHEDULER_EDF
+	task_state[id].period = 0;
+	task_state[id].density = 0;
+	task_state[id].deadline = tick_count;
+	task_state[id].deadline_misses = 0;
+#endif
+	SCHEDULER_ReadyAdd(id);
 	
 }
 
-void SysTick_Handler()
+/* slot of a live task, NO_TASK if it is not running */
+static uint32_t SCHEDULER_TaskId(task_t *task)
 {
 	
-	if (!msp_in_use)
+	uint32_t i;
+	for (i = 0; i < MAX_TASKS; i++)
 	{
-		__asm volatile (
-			"STMIA %1!, {r4-r11}\n\t"
-			"MRS %0, PSP\n\t"
-				: "=r" (task_table[current_task].task->stack)
-				: "r" (&task_table[current_task].task->sw_stack_frame)
-		);
+		
+		if ((task_table[i].flags & IN_USE_FLAG) && task_state[i].task == task)
+		{
+			return i;
+		}
+		
 	}
+	
+	return NO_TASK;
+	
+}
 
-	msp_in_use = false;
-
-	do
+/*
+ * Sets how many ticks a task runs before the other ready tasks at its
+ * priority get a turn. Takes effect from its next switch in.
+ */
+bool SCHEDULER_SetQuantum(task_t *task, uint32_t ticks)
+{
+	
+	uint32_t id = SCHEDULER_TaskId(task);
+	
+	if (id == NO_TASK || ticks == 0)
 	{
+		return false;
+	}
+	
+	task_state[id].quantum = ticks;
+	
+	return true;
+	
+}
 
-		current_task = (current_task + 1) % MAX_TASKS;
+#ifdef SCHEDULER_BUDGET
+/*
+ * Limits a task to budget ticks of CPU time in every period ticks, a budget
+ * of 0 lifts the limit. A task that uses up its budget while still runnable
+ * is throttled until its next replenishment and counted as an overrun.
+ */
+bool SCHEDULER_SetBudget(task_t *task, uint32_t budget, uint32_t period)
+{
+	
+	uint32_t id = SCHEDULER_TaskId(task);
+	
+	if (id == NO_TASK || (budget && budget >= period))
+	{
+		return false;
+	}
+	
+	INT_Disable();
+	
+	task_state[id].budget = budget;
+	task_state[id].budget_period = period;
+	task_state[id].budget_used = 0;
+	task_state[id].replenish_tick = tick_count;
+	
+	INT_Enable();
+	
+	return true;
+	
+}
 
-		if (task_table[current_task].flags & (EXEC_FLAG | IN_USE_FLAG))
-		{
+/* times a task has been throttled for using up its budget */
+uint32_t SCHEDULER_Overruns(task_t *task)
+{
+	
+	uint32_t id = SCHEDULER_TaskId(task);
+	
+	return id != NO_TASK ? task_state[id].overruns : 0;
+	
+}
+#endif
 
-			break;
+void SCHEDULER_EventInit(event_t *event)
+{
+	
+	event->head = NO_TASK;
+	event->tail = NO_TASK;
+	
+}
 
-		}
+/*
+ * Blocks the calling task on the event until it is signalled with any of
+ * the given bits, and returns the bits that woke it.
+ */
+uint32_t SCHEDULER_EventWait(event_t *event, uint32_t bits)
+{
+	
+	return SCHEDULER_EventWaitTimeout(event, bits, WAIT_FOREVER);
+	
+}
 
+/*
+ * As SCHEDULER_EventWait, but gives up after timeout ticks and returns 0.
+ */
+uint32_t SCHEDULER_EventWaitTimeout(event_t *event, uint32_t bits, uint32_t timeout)
+{
+	
+	if (timeout == 0)
+	{
+		return 0;
 	}
-	while(1);
-
-	__asm volatile(
-		"mov lr, #0xFFFFFFFD\n\t"
-		"LDMIA %0!, {r4-r11}\n\t"
-		"MSR PSP, %1\n\t"
-		:
-		: "r" (&task_table[current_task].task->sw_stack_frame),
-			"r" (task_table[current_task].task->stack)
-	);
+	
+	INT_Disable();
+	
+	task_state[current_task].wait_bits = bits;
+	SCHEDULER_WaitListAdd(event);
+	SCHEDULER_BlockTimeout(timeout);
+	
+	INT_Enable();
+	
+	// the switch happens when interrupts are enabled again
+	return task_state[current_task].wait_bits;
 	
 }
 
-void PendSV_Handler()
+/*
+ * Wakes every task waiting on the event for any of the given bits. Only the
+ * event's own wait list is walked, so the cost is O(waiters). Safe to call
+ * from interrupts.
+ */
+void SCHEDULER_EventSignal(event_t *event, uint32_t bits)
 {
 	
-	if (!msp_in_use)
+	INT_Disable();
+	
+	uint32_t prev = NO_TASK;
+	uint32_t id = event->head;
+	
+	while (id != NO_TASK)
 	{
-		__asm volatile (
-			"STMIA %1!, {r4-r11}\n\t"
-			"MRS %0, PSP\n\t"
-				: "=r" (task_table[current_task].task->stack)
-				: "r" (&task_table[current_task].task->sw_stack_frame)
-		);
+		
+		uint32_t next = task_state[id].wait_next;
+		
+		if (task_state[id].wait_bits & bits)
+		{
+			
+			SCHEDULER_WaitListRemove(event, prev, id);
+			task_state[id].wait_bits &= bits;
+			SCHEDULER_Wake(id);
+			
+		}
+		else
+		{
+			prev = id;
+		}
+		
+		id = next;
+		
 	}
+	
+	INT_Enable();
+	
+}
 
-	msp_in_use = false;
+void SCHEDULER_SemInit(semaphore_t *sem, uint32_t count)
+{
+	
+	sem->count = count;
+	SCHEDULER_EventInit(&sem->waiters);
+	
+}
 
+/*
+ * Takes a unit without blocking; false if none is left. The decrement is an
+ * LDREX/STREX loop, so it is safe from interrupts and never enters the kernel.
+ */
+bool SCHEDULER_SemTryTake(semaphore_t *sem)
+{
+	
+	uint32_t count;
+	
 	do
 	{
+		
+		count = __LDREXW(&sem->count);
+		
+		if (count == 0)
+		{
+			__CLREX();
+			return false;
+		}
+		
+	}
+	while (__STREXW(count - 1, &sem->count));
+	
+	return true;
+	
+}
 
-		current_task = (current_task + 1) % MAX_TASKS;
+/*
+ * Takes a unit, blocking while the count is zero. A blocked taker is handed
+ * the unit directly by the give that wakes it.
+ */
+void SCHEDULER_SemTake(semaphore_t *sem)
+{
+	
+	if (SCHEDULER_SemTryTake(sem))
+	{
+		return;
+	}
+	
+	INT_Disable();
+	
+	// a give may have slipped in before interrupts were disabled
+	if (sem->count)
+	{
+		sem->count--;
+	}
+	else
+	{
+		SCHEDULER_WaitListAdd(&sem->waiters);
+		SCHEDULER_Block();
+	}
+	
+	INT_Enable();
+	
+}
 
-		if (task_table[current_task].flags & (EXEC_FLAG | IN_USE_FLAG))
+/*
+ * Returns a unit. Without waiters this is just an LDREX/STREX increment; an
+ * interrupt between the two clears the exclusive monitor, so a taker that
+ * queues up in the meantime makes the STREX fail and the give retry. Safe to
+ * call from interrupts.
+ */
+void SCHEDULER_SemGive(semaphore_t *sem)
+{
+	
+	uint32_t count;
+	
+	do
+	{
+		
+		count = __LDREXW(&sem->count);
+		
+		if (sem->waiters.head != NO_TASK)
 		{
-
+			__CLREX();
 			break;
-
 		}
-
+		
+		if (!__STREXW(count + 1, &sem->count))
+		{
+			return;
+		}
+		
 	}
-	while(1);
-
-	__asm volatile(
-		"mov lr, #0xFFFFFFFD\n\t"
-		"LDMIA %0!, {r4-r11}\n\t"
-		"MSR PSP, %1\n\t"
-		:
-		: "r" (&task_table[current_task].task->sw_stack_frame),
-			"r" (task_table[current_task].task->stack)
-	);
+	while (1);
+	
+	INT_Disable();
+	
+	uint32_t id = SCHEDULER_WaitListPop(&sem->waiters);
+	
+	if (id != NO_TASK)
+	{
+		SCHEDULER_Wake(id);
+	}
+	else
+	{
+		sem->count++;
+	}
+	
+	INT_Enable();
+	
+}
+
+void SCHEDULER_MutexInit(mutex_t *mutex)
+{
+	
+	mutex->owner = 0;
+	SCHEDULER_EventInit(&mutex->waiters);
+	
+}
+
+/*
+ * Locks the mutex, blocking while another task holds it. The holder inherits
+ * the priority of its highest waiter, passed along the chain if the holder is
+ * itself blocked on another mutex. Not for use from interrupts.
+ */
+void SCHEDULER_MutexLock(mutex_t *mutex)
+{
+	
+	uint32_t self = current_task + 1;
+	
+	if (!__LDREXW(&mutex->owner))
+	{
+		
+		if (!__STREXW(self, &mutex->owner))
+		{
+			task_state[current_task].mutexes_held++;
+			return;
+		}
+		
+	}
+	else
+	{
+		__CLREX();
+	}
+	
+	INT_Disable();
+	
+	if (!mutex->owner)
+	{
+		mutex->owner = self;
+		task_state[current_task].mutexes_held++;
+	}
+	else
+	{
+		
+		uint32_t priority = task_table[current_task].priority;
+		mutex_t *blocker = mutex;
+		
+		while (blocker)
+		{
+			
+			uint32_t owner = blocker->owner - 1;
+			
+#ifdef SCHEDULER_EDF
+			// at EDF_PRIORITY the owner also runs on the waiter's deadline
+			if (priority == EDF_PRIORITY && (task_table[owner].priority != EDF_PRIORITY || (int32_t)(task_state[current_task].deadline - task_state[owner].deadline) < 0))
+			{
+				
+				task_state[owner].deadline = task_state[current_task].deadline;
+				SCHEDULER_SetPriority(owner, EDF_PRIORITY);
+				blocker = task_state[owner].wait_mutex;
+				continue;
+				
+			}
+#endif
+			
+			if (task_table[owner].priority >= priority)
+			{
+				break;
+			}
+			
+			SCHEDULER_SetPriority(owner, priority);
+			blocker = task_state[owner].wait_mutex;
+			
+		}
+		
+		// ownership is handed over by the unlock that wakes us
+		task_state[current_task].wait_mutex = mutex;
+		SCHEDULER_WaitListAdd(&mutex->waiters);
+		SCHEDULER_Block();
+		
+	}
+	
+	INT_Enable();
+	
+}
+
+bool SCHEDULER_MutexTryLock(mutex_t *mutex)
+{
+	
+	do
+	{
+		
+		if (__LDREXW(&mutex->owner))
+		{
+			__CLREX();
+			return false;
+		}
+		
+	}
+	while (__STREXW(current_task + 1, &mutex->owner));
+	
+	task_state[current_task].mutexes_held++;
+	
+	return true;
+	
+}
+
+/*
+ * Unlocks a mutex held by the calling task. Without waiters the owner is
+ * cleared with LDREX/STREX; otherwise ownership passes straight to the
+ * highest-priority waiter. Inherited priority is dropped once the task holds
+ * no mutex anymore.
+ */
+void SCHEDULER_MutexUnlock(mutex_t *mutex)
+{
+	
+	task_state[current_task].mutexes_held--;
+	
+	do
+	{
+		
+		__LDREXW(&mutex->owner);
+		
+		if (mutex->waiters.head != NO_TASK)
+		{
+			__CLREX();
+			break;
+		}
+		
+		if (!__STREXW(0, &mutex->owner))
+		{
+			
+			if (!task_state[current_task].mutexes_held && SCHEDULER_Boosted(current_task))
+			{
+				INT_Disable();
+				SCHEDULER_Unboost(current_task);
+				SCHEDULER_PendSwitch();
+				INT_Enable();
+			}
+			
+#ifdef SCHEDULER_BUDGET
+			// throttling is held off while a task holds a mutex
+			if (!task_state[current_task].mutexes_held && task_state[current_task].budget)
+			{
+				INT_Disable();
+				SCHEDULER_BudgetThrottle();
+				INT_Enable();
+			}
+#endif
+			
+			return;
+			
+		}
+		
+	}
+	while (1);
+	
+	INT_Disable();
+	
+	uint32_t id = SCHEDULER_WaitListPop(&mutex->waiters);
+	
+	mutex->owner = id + 1;
+	task_state[id].wait_mutex = 0;
+	task_state[id].mutexes_held++;
+	
+	// the new owner inherits from the waiters still queued behind it
+	uint32_t waiter;
+	for (waiter = mutex->waiters.head; waiter != NO_TASK; waiter = task_state[waiter].wait_next)
+	{
+		
+#ifdef SCHEDULER_EDF
+		if (task_table[waiter].priority == EDF_PRIORITY && (task_table[id].priority != EDF_PRIORITY || (int32_t)(task_state[waiter].deadline - task_state[id].deadline) < 0))
+		{
+			task_state[id].deadline = task_state[waiter].deadline;
+		}
+#endif
+		
+		if (task_table[waiter].priority > task_table[id].priority)
+		{
+			task_table[id].priority = task_table[waiter].priority;
+		}
+		
+	}
+	
+	if (!task_state[current_task].mutexes_held)
+	{
+		SCHEDULER_Unboost(current_task);
+#ifdef SCHEDULER_BUDGET
+		SCHEDULER_BudgetThrottle();
+#endif
+	}
+	
+	SCHEDULER_Wake(id);
+	SCHEDULER_PendSwitch();
+	
+	INT_Enable();
+	
+}
+
+bool SCHEDULER_QueueInit(queue_t *queue, void **slots, uint32_t capacity)
+{
+	
+	if (capacity == 0)
+	{
+		return false;
+	}
+	
+	queue->slots = slots;
+	queue->capacity = capacity;
+	queue->count = 0;
+	queue->head = 0;
+	SCHEDULER_EventInit(&queue->receivers);
+	SCHEDULER_EventInit(&queue->senders);
+	
+	return true;
+	
+}
+
+/*
+ * Queues a message pointer, blocking up to timeout ticks while the queue is
+ * full. A blocked receiver gets the pointer directly in its TCB without it
+ * passing through the slots. With a timeout of 0 it never blocks, which is
+ * how interrupts must call it.
+ */
+bool SCHEDULER_QueueSend(queue_t *queue, void *msg, uint32_t timeout)
+{
+	
+	INT_Disable();
+	
+	uint32_t id = SCHEDULER_WaitListPop(&queue->receivers);
+	
+	if (id != NO_TASK)
+	{
+		task_state[id].msg = msg;
+		SCHEDULER_Wake(id);
+		INT_Enable();
+		return true;
+	}
+	
+	if (queue->count < queue->capacity)
+	{
+		
+		uint32_t tail = queue->head + queue->count;
+		
+		if (tail >= queue->capacity)
+		{
+			tail -= queue->capacity;
+		}
+		
+		queue->slots[tail] = msg;
+		queue->count++;
+		INT_Enable();
+		
+		return true;
+		
+	}
+	
+	if (timeout == 0)
+	{
+		INT_Enable();
+		return false;
+	}
+	
+	// a receiver that frees a slot moves msg in and wakes us with 1
+	task_state[current_task].msg = msg;
+	task_state[current_task].wait_bits = 1;
+	SCHEDULER_WaitListAdd(&queue->senders);
+	SCHEDULER_BlockTimeout(timeout);
+	
+	INT_Enable();
+	
+	return task_state[current_task].wait_bits != 0;
+	
+}
+
+/*
+ * Takes the oldest message pointer, blocking up to timeout ticks while the
+ * queue is empty. Not for use from interrupts unless timeout is 0.
+ */
+bool SCHEDULER_QueueReceive(queue_t *queue, void **msg, uint32_t timeout)
+{
+	
+	INT_Disable();
+	
+	if (queue->count)
+	{
+		
+		*msg = queue->slots[queue->head];
+		
+		// refill the freed slot from a blocked sender, keeping FIFO order
+		uint32_t id = SCHEDULER_WaitListPop(&queue->senders);
+		
+		if (id != NO_TASK)
+		{
+			queue->slots[queue->head] = task_state[id].msg;
+			queue->head = (queue->head + 1 < queue->capacity) ? queue->head + 1 : 0;
+			SCHEDULER_Wake(id);
+		}
+		else
+		{
+			queue->head = (queue->head + 1 < queue->capacity) ? queue->head + 1 : 0;
+			queue->count--;
+		}
+		
+		INT_Enable();
+		
+		return true;
+		
+	}
+	
+	if (timeout == 0)
+	{
+		INT_Enable();
+		return false;
+	}
+	
+	task_state[current_task].wait_bits = 1;
+	SCHEDULER_WaitListAdd(&queue->receivers);
+	SCHEDULER_BlockTimeout(timeout);
+	
+	INT_Enable();
+	
+	if (!task_state[current_task].wait_bits)
+	{
+		return false;
+	}
+	
+	*msg = task_state[current_task].msg;
+	
+	return true;
+	
+}
+
+/* compatibility layer, all flags share one event */
+void SCHEDULER_Wait(uint32_t flags)
+{
+	
+	SCHEDULER_EventWait(&flag_event, flags);
+	
+}
+
+void SCHEDULER_Release(uint32_t flags)
+{
+	
+	SCHEDULER_EventSignal(&flag_event, flags);
+	
+}
+
+/*
+ * Takes the running task off the ready lists; it stops running once
+ * interrupts are enabled again. Must be called with interrupts disabled.
+ */
+static void SCHEDULER_Block()
+{
+	
+	task_table[current_task].flags &= (~EXEC_FLAG);
+	SCHEDULER_ReadyRemove(current_task);
+	SCHEDULER_PendSwitch();
+	
+#ifdef SCHEDULER_TRACE
+	TRACE_Record(TRACE_WAIT, current_task, 0);
+#endif
+	
+}
+
+/*
+ * Blocks the running task like SCHEDULER_Block, giving up after timeout
+ * ticks unless it is WAIT_FOREVER. Must be called with interrupts disabled.
+ */
+static void SCHEDULER_BlockTimeout(uint32_t timeout)
+{
+	
+	if (timeout != WAIT_FOREVER)
+	{
+		SCHEDULER_SleepInsert(timeout);
+	}
+	
+	SCHEDULER_Block();
+	
+}
+
+/* must be called with interrupts disabled */
+static void SCHEDULER_Wake(uint32_t id)
+{
+	
+	// woken before its timeout ran out
+	if (task_table[id].flags & SLEEP_FLAG)
+	{
+		SCHEDULER_SleepRemove(id);
+	}
+	
+	task_table[id].flags |= EXEC_FLAG;
+	SCHEDULER_ReadyAdd(id);
+	SCHEDULER_Preempt(id);
+	
+#ifdef SCHEDULER_INSTRUMENT
+	wake_stamp[id] = DWT_CycleCount() | 1;
+#endif
+	
+#ifdef SCHEDULER_STATS
+	if (task_state[id].blocked_at)
+	{
+		task_state[id].stats.blocked_cycles += DWT_CycleCount() - task_state[id].blocked_at;
+		task_state[id].blocked_at = 0;
+	}
+#endif
+	
+#ifdef SCHEDULER_TRACE
+	uint32_t exception = __get_IPSR();
+	TRACE_Record(TRACE_RELEASE, id, exception ? (TRACE_FROM_ISR | exception) : current_task);
+#endif
+	
+}
+
+/* moves a task to another priority level. Must be called with interrupts disabled */
+static void SCHEDULER_SetPriority(uint32_t id, uint32_t priority)
+{
+	
+	if (task_table[id].flags & EXEC_FLAG)
+	{
+		SCHEDULER_ReadyRemove(id);
+		task_table[id].priority = priority;
+		SCHEDULER_ReadyAdd(id);
+	}
+	else
+	{
+		task_table[id].priority = priority;
+	}
+	
+}
+
+/* whether a task runs on a priority or deadline inherited through a mutex */
+static bool SCHEDULER_Boosted(uint32_t id)
+{
+	
+#ifdef SCHEDULER_EDF
+	if ((task_table[id].flags & PERIODIC_FLAG) && task_state[id].deadline != task_state[id].release + task_state[id].relative_deadline)
+	{
+		return true;
+	}
+#endif
+	
+	return task_table[id].priority != task_state[id].base_priority;
+	
+}
+
+/* drops what a task inherited. Must be called with interrupts disabled */
+static void SCHEDULER_Unboost(uint32_t id)
+{
+	
+#ifdef SCHEDULER_EDF
+	if (task_table[id].flags & PERIODIC_FLAG)
+	{
+		task_state[id].deadline = task_state[id].release + task_state[id].relative_deadline;
+	}
+#endif
+	
+	SCHEDULER_SetPriority(id, task_state[id].base_priority);
+	
+}
+
+/*
+ * Recomputes what a mutex owner inherits from the tasks still blocked on the
+ * mutexes it holds, after one of them left, and carries a change along to
+ * the owner of the mutex it is blocked on in turn. Must be called with
+ * interrupts disabled.
+ */
+static void SCHEDULER_Reinherit(uint32_t id)
+{
+	
+	while (1)
+	{
+		
+		uint32_t priority = task_state[id].base_priority;
+#ifdef SCHEDULER_EDF
+		uint32_t deadline = task_state[id].deadline;
+		
+		if (task_table[id].flags & PERIODIC_FLAG)
+		{
+			deadline = task_state[id].release + task_state[id].relative_deadline;
+		}
+#endif
+		
+		uint32_t waiter;
+		for (waiter = 0; waiter < MAX_TASKS; waiter++)
+		{
+			
+			mutex_t *mutex = task_state[waiter].wait_mutex;
+			
+			if (!mutex || mutex->owner != id + 1)
+			{
+				continue;
+			}
+			
+#ifdef SCHEDULER_EDF
+			if (task_table[waiter].priority == EDF_PRIORITY && (priority != EDF_PRIORITY || (int32_t)(task_state[waiter].deadline - deadline) < 0))
+			{
+				priority = EDF_PRIORITY;
+				deadline = task_state[waiter].deadline;
+				continue;
+			}
+#endif
+			
+			if (task_table[waiter].priority > priority)
+			{
+				priority = task_table[waiter].priority;
+			}
+			
+		}
+		
+#ifdef SCHEDULER_EDF
+		if (priority == task_table[id].priority && deadline == task_state[id].deadline)
+		{
+			break;
+		}
+		
+		task_state[id].deadline = deadline;
+#else
+		if (priority == task_table[id].priority)
+		{
+			break;
+		}
+#endif
+		
+		SCHEDULER_SetPriority(id, priority);
+		SCHEDULER_PendSwitch();
+		
+		if (!task_state[id].wait_mutex)
+		{
+			break;
+		}
+		
+		id = task_state[id].wait_mutex->owner - 1;
+		
+	}
+	
+}
+
+/* wait list helpers, must be called with interrupts disabled */
+static void SCHEDULER_WaitListAdd(event_t *list)
+{
+	
+	task_state[current_task].wait_next = NO_TASK;
+	
+	if (list->tail == NO_TASK)
+	{
+		list->head = current_task;
+	}
+	else
+	{
+		task_state[list->tail].wait_next = current_task;
+	}
+	
+	list->tail = current_task;
+	task_state[current_task].wait_list = list;
+	
+}
+
+static void SCHEDULER_WaitListRemove(event_t *list, uint32_t prev, uint32_t id)
+{
+	
+	uint32_t next = task_state[id].wait_next;
+	
+	if (prev == NO_TASK)
+	{
+		list->head = next;
+	}
+	else
+	{
+		task_state[prev].wait_next = next;
+	}
+	
+	if (list->tail == id)
+	{
+		list->tail = prev;
+	}
+	
+	task_state[id].wait_next = NO_TASK;
+	task_state[id].wait_list = 0;
+	
+}
+
+/* unlinks a task from whichever wait list it is on */
+static void SCHEDULER_WaitListUnlink(uint32_t id)
+{
+	
+	event_t *list = task_state[id].wait_list;
+	uint32_t prev = NO_TASK;
+	uint32_t waiter = list->head;
+	
+	while (waiter != id)
+	{
+		prev = waiter;
+		waiter = task_state[waiter].wait_next;
+	}
+	
+	SCHEDULER_WaitListRemove(list, prev, id);
+	
+}
+
+/* unlinks the highest-priority waiter, the longest waiting among equals */
+static uint32_t SCHEDULER_WaitListPop(event_t *list)
+{
+	
+	uint32_t best = list->head;
+	uint32_t best_prev = NO_TASK;
+	uint32_t prev = list->head;
+	
+	if (best == NO_TASK)
+	{
+		return NO_TASK;
+	}
+	
+	uint32_t id;
+	for (id = task_state[best].wait_next; id != NO_TASK; id = task_state[id].wait_next)
+	{
+		
+		if (task_table[id].priority > task_table[best].priority)
+		{
+			best = id;
+			best_prev = prev;
+		}
+		
+		prev = id;
+		
+	}
+	
+	SCHEDULER_WaitListRemove(list, best_prev, best);
+	
+	return best;
+	
+}
+
+void SCHEDULER_Yield()
+{
+	
+#ifdef SCHEDULER_STATS
+	task_state[current_task].yielded = 1;
+#endif
+	SCHEDULER_PendSwitch();
+	
+}
+
+/* requests a switch, taken as soon as PendSV is allowed to run */
+static void SCHEDULER_PendSwitch()
+{
+	
+	PORT_PendSwitch();
+	
+}
+
+/*
+ * Switches away right away if task id outranks the running task, instead of
+ * waiting for the next time slice. Must be called with interrupts disabled.
+ */
+static void SCHEDULER_Preempt(uint32_t id)
+{
+	
+	if (task_table[id].priority > task_table[current_task].priority)
+	{
+		SCHEDULER_PendSwitch();
+	}
+#ifdef SCHEDULER_EDF
+	else if (id == edf_head && id != current_task)
+	{
+		// sorted in after equal deadlines, so at the head it is strictly earlier
+		SCHEDULER_PendSwitch();
+	}
+#endif
+	
+}
+
+/*
+ * Blocks the calling task for the given number of ticks. Sleepers are kept
+ * in a delta list sorted by wakeup time, each entry holding the ticks after
+ * the one before it, so a tick only ever touches the head of the list.
+ */
+void SCHEDULER_Sleep(uint32_t ticks)
+{
+	
+	if (ticks == 0)
+	{
+		SCHEDULER_Yield();
+		return;
+	}
+	
+	INT_Disable();
+	SCHEDULER_SleepInsert(ticks);
+	SCHEDULER_Block();
+	INT_Enable();
+	
+}
+
+void SCHEDULER_SleepUntil(uint32_t tick)
+{
+	
+	int32_t ticks = (int32_t)(tick - tick_count);
+	
+	SCHEDULER_Sleep(ticks > 0 ? ticks : 0);
+	
+}
+
+/*
+ * Moves time forward for the sleepers, waking every task whose delay has
+ * run out. Must be called with interrupts disabled.
+ */
+static void SCHEDULER_SleepAdvance(uint32_t ticks)
+{
+	
+	while (sleep_head != NO_TASK)
+	{
+		
+		uint32_t id = sleep_head;
+		
+		if (task_state[id].delay > ticks)
+		{
+			task_state[id].delay -= ticks;
+			break;
+		}
+		
+		ticks -= task_state[id].delay;
+		sleep_head = task_state[id].sleep_next;
+		task_state[id].sleep_next = NO_TASK;
+		task_table[id].flags &= (~SLEEP_FLAG);
+		
+		// a timed out wait leaves its wait list empty handed
+		if (task_state[id].wait_list)
+		{
+			SCHEDULER_WaitListUnlink(id);
+			task_state[id].wait_bits = 0;
+		}
+		
+		SCHEDULER_Wake(id);
+		
+	}
+	
+}
+
+/*
+ * Files the running task in the delta list, walking past the sleepers that
+ * wake first. Must be called with interrupts disabled.
+ */
+static void SCHEDULER_SleepInsert(uint32_t ticks)
+{
+	
+	uint32_t *link = &sleep_head;
+	
+	while (*link != NO_TASK && task_state[*link].delay <= ticks)
+	{
+		ticks -= task_state[*link].delay;
+		link = &task_state[*link].sleep_next;
+	}
+	
+	if (*link != NO_TASK)
+	{
+		task_state[*link].delay -= ticks;
+	}
+	
+	task_state[current_task].delay = ticks;
+	task_state[current_task].sleep_next = *link;
+	task_table[current_task].flags |= SLEEP_FLAG;
+	*link = current_task;
+	
+}
+
+/*
+ * Takes a task out of the delta list before its time, handing its remaining
+ * delay on to the sleeper behind it. Must be called with interrupts disabled.
+ */
+static void SCHEDULER_SleepRemove(uint32_t id)
+{
+	
+	uint32_t *link = &sleep_head;
+	
+	while (*link != id)
+	{
+		link = &task_state[*link].sleep_next;
+	}
+	
+	*link = task_state[id].sleep_next;
+	
+	if (*link != NO_TASK)
+	{
+		task_state[*link].delay += task_state[id].delay;
+	}
+	
+	task_state[id].sleep_next = NO_TASK;
+	task_table[id].flags &= (~SLEEP_FLAG);
+	
+}
+
+/*
+ * Ends the calling task, also reached by returning from its entry point. Its
+ * joiners are woken and the switch away is taken as soon as interrupts are
+ * enabled again; the slot and a pooled stack are only freed by that switch,
+ * once nothing runs on the stack anymore. A task still holding a mutex is
+ * refused like SCHEDULER_TaskDelete refuses it: it stops for good but keeps
+ * its slot, so the mutex owner id never passes to a task reusing the slot.
+ */
+void SCHEDULER_TaskExit()
+{
+	
+	INT_Disable();
+	
+	if (task_state[current_task].mutexes_held)
+	{
+		SCHEDULER_Block();
+		INT_Enable();
+		while(1);
+	}
+	
+#ifdef SCHEDULER_EDF
+	edf_density -= task_state[current_task].density;
+#endif
+	task_table[current_task].flags = EXIT_FLAG;
+	SCHEDULER_ReadyRemove(current_task);
+	SCHEDULER_EventSignal(&exit_event, 1 << current_task);
+	SCHEDULER_PendSwitch();
+	INT_Enable();
+	while(1);
+	
+}
+
+/*
+ * Ends another task wherever it is blocked or ready, freeing its slot and a
+ * pooled stack right away. Deleting the caller is SCHEDULER_TaskExit, which
+ * an interrupt cannot do to the task it interrupted. Refused then, for the
+ * idle task and for a task holding a mutex, which would stay locked.
+ */
+bool SCHEDULER_TaskDelete(task_t *task)
+{
+	
+	INT_Disable();
+	
+	uint32_t id = SCHEDULER_TaskId(task);
+	
+	if (id == current_task)
+	{
+		
+		INT_Enable();
+		
+		if (__get_IPSR())
+		{
+			return false;
+		}
+		
+		SCHEDULER_TaskExit();
+		
+	}
+	
+	if (id == NO_TASK || id == idle_task_id || task_state[id].mutexes_held)
+	{
+		INT_Enable();
+		return false;
+	}
+	
+	if (task_table[id].flags & SLEEP_FLAG)
+	{
+		SCHEDULER_SleepRemove(id);
+	}
+	
+	if (task_state[id].wait_list)
+	{
+		SCHEDULER_WaitListUnlink(id);
+	}
+	
+	if (task_table[id].flags & EXEC_FLAG)
+	{
+		SCHEDULER_ReadyRemove(id);
+	}
+	
+#ifdef SCHEDULER_EDF
+	edf_density -= task_state[id].density;
+#endif
+	
+	// the owner of a mutex it waited on may have inherited from it
+	mutex_t *mutex = task_state[id].wait_mutex;
+	task_state[id].wait_mutex = 0;
+	
+	if (mutex)
+	{
+		SCHEDULER_Reinherit(mutex->owner - 1);
+	}
+	
+	SCHEDULER_TaskRelease(id);
+	SCHEDULER_EventSignal(&exit_event, 1 << id);
+	
+	INT_Enable();
+	
+	return true;
+	
+}
+
+/*
+ * Blocks until task has exited or been deleted, giving up after timeout
+ * ticks unless it is WAIT_FOREVER. True at once if it is not running; false
+ * on timeout or when a task tries to join itself.
+ */
+bool SCHEDULER_TaskJoin(task_t *task, uint32_t timeout)
+{
+	
+	INT_Disable();
+	
+	uint32_t id = SCHEDULER_TaskId(task);
+	
+	if (id == NO_TASK)
+	{
+		INT_Enable();
+		return true;
+	}
+	
+	if (id == current_task || timeout == 0)
+	{
+		INT_Enable();
+		return false;
+	}
+	
+	task_state[current_task].wait_bits = 1 << id;
+	SCHEDULER_WaitListAdd(&exit_event);
+	SCHEDULER_BlockTimeout(timeout);
+	
+	INT_Enable();
+	
+	return task_state[current_task].wait_bits != 0;
+	
+}
+
+#ifdef SCHEDULER_TASK_POOL
+/*
+ * Starts a task on a stack from the pool, which goes back to the pool when
+ * the task ends. Returns 0 if the pool or the slots are used up. The task_t
+ * is reused by later spawns, so join it before spawning again from elsewhere.
+ */
+task_t *SCHEDULER_TaskSpawn(void *entry_point, uint32_t priority)
+{
+	
+	if (!SCHEDULER_PriorityValid(priority))
+	{
+		return 0;
+	}
+	
+	INT_Disable();
+	
+	uint32_t slot = __CLZ(__RBIT(~pool_used));
+	
+	if (slot >= TASK_POOL_SIZE)
+	{
+		INT_Enable();
+		return 0;
+	}
+	
+	pool_used |= (1 << slot);
+	
+	INT_Enable();
+	
+	if (SCHEDULER_TaskCreate(&pool_tasks[slot], entry_point, priority) == NO_TASK)
+	{
+		
+		INT_Disable();
+		pool_used &= ~(1 << slot);
+		INT_Enable();
+		
+		return 0;
+		
+	}
+	
+	return &pool_tasks[slot];
+	
+}
+#endif
+
+/* frees a task's slot and pooled stack. Must be called with interrupts disabled */
+static void SCHEDULER_TaskRelease(uint32_t id)
+{
+	
+	task_table[id].flags = 0;
+	
+#ifdef SCHEDULER_TASK_POOL
+	task_t *task = task_state[id].task;
+	
+	if (task >= pool_tasks && task < pool_tasks + TASK_POOL_SIZE)
+	{
+		pool_used &= ~(1 << (task - pool_tasks));
+	}
+#endif
+	
+}
+
+bool SCHEDULER_IdleHookAdd(idle_hook_t hook)
+{
+	
+	bool added = false;
+	
+	INT_Disable();
+	
+	if (idle_hook_count < IDLE_HOOKS_MAX)
+	{
+		idle_hooks[idle_hook_count++] = hook;
+		added = true;
+	}
+	
+	INT_Enable();
+	
+	return added;
+	
+}
+
+#ifdef SCHEDULER_BUDGET
+/*
+ * Charges the tick to the running task's budget, replenishing it first if a
+ * period has passed since the last replenishment. Once the budget is spent
+ * the task sleeps until its next replenishment; one holding a mutex is left
+ * to run until it has let go of them all. Called from SysTick with
+ * interrupts disabled.
+ */
+static void SCHEDULER_BudgetCharge()
+{
+	
+	task_state_t *state = &task_state[current_task];
+	
+	// a task blocking at the tick has already given up the CPU
+	if (!state->budget || !(task_table[current_task].flags & EXEC_FLAG))
+	{
+		return;
+	}
+	
+	uint32_t elapsed = tick_count - state->replenish_tick;
+	
+	if (elapsed >= state->budget_period)
+	{
+		state->replenish_tick += elapsed - elapsed % state->budget_period;
+		state->budget_used = 0;
+	}
+	
+	state->budget_used++;
+	
+	if (!state->mutexes_held)
+	{
+		SCHEDULER_BudgetThrottle();
+	}
+	
+}
+
+/*
+ * Puts the running task to sleep until its next replenishment if its budget
+ * for this period is spent. Must be called with interrupts disabled.
+ */
+static void SCHEDULER_BudgetThrottle()
+{
+	
+	task_state_t *state = &task_state[current_task];
+	
+	if (!state->budget || state->budget_used < state->budget || tick_count - state->replenish_tick >= state->budget_period)
+	{
+		return;
+	}
+	
+	state->overruns++;
+	SCHEDULER_SleepInsert(state->replenish_tick + state->budget_period - tick_count);
+	SCHEDULER_Block();
+	
+}
+#endif
+
+#ifdef SCHEDULER_STATS
+/*
+ * Copies the counters of up to max tasks in use into stats and returns how
+ * many were written. The running task's current slice is included.
+ */
+uint32_t SCHEDULER_GetStats(task_stats_t *stats, uint32_t max)
+{
+	
+	uint32_t count = 0;
+	
+	INT_Disable();
+	
+	uint32_t i;
+	for (i = 0; i < MAX_TASKS && count < max; i++)
+	{
+		
+		if (task_table[i].flags & IN_USE_FLAG)
+		{
+			
+			stats[count] = task_state[i].stats;
+			stats[count].task = task_state[i].task;
+			stats[count].priority = task_table[i].priority;
+#ifdef SCHEDULER_BUDGET
+			stats[count].overruns = task_state[i].overruns;
+#endif
+			
+			if (i == current_task)
+			{
+				stats[count].run_cycles += DWT_CycleCount() - switched_in;
+			}
+			
+			count++;
+			
+		}
+		
+	}
+	
+	INT_Enable();
+	
+	return count;
+	
+}
+
+/* percentage of the last LOAD_WINDOW ticks spent outside the idle task */
+uint32_t SCHEDULER_GetLoad()
+{
+	
+	return load_percent;
+	
+}
+
+/*
+ * Charges the cycles since the last switch to the outgoing task, counts how
+ * it gave up the CPU and starts the incoming task's slice. Called from
+ * SCHEDULER_Switch with interrupts disabled; save is false on the first
+ * switch out of main.
+ */
+static void SCHEDULER_StatsSwitch(uint32_t previous, bool save)
+{
+	
+	uint32_t now = DWT_CycleCount();
+	
+	if (save)
+	{
+		
+		task_state_t *out = &task_state[previous];
+		uint32_t ran = now - switched_in;
+		
+		out->stats.run_cycles += ran;
+		
+		if (previous != idle_task_id)
+		{
+			busy_cycles += ran;
+		}
+		
+		if (!(task_table[previous].flags & EXEC_FLAG))
+		{
+			out->stats.yields++;
+			out->blocked_at = now | 1;
+		}
+		else if (out->yielded)
+		{
+			out->stats.yields++;
+		}
+		else
+		{
+			out->stats.preemptions++;
+		}
+		
+		out->yielded = 0;
+		
+	}
+	
+	task_state[current_task].stats.switches++;
+	switched_in = now;
+	
+}
+
+/*
+ * Called from SysTick once LOAD_WINDOW ticks have passed. The window is sized
+ * from the tick count rather than the cycle counter, which stops in EM2 sleep,
+ * and a tickless sleep may have stretched it past LOAD_WINDOW.
+ */
+static void SCHEDULER_StatsLoad()
+{
+	
+	uint64_t busy = busy_cycles;
+	
+	if (current_task != idle_task_id)
+	{
+		busy += DWT_CycleCount() - switched_in;
+	}
+	
+	uint64_t window = (uint64_t)(tick_count - load_window_tick) * TASK_DURATION;
+	uint64_t used = busy - load_window_start;
+	
+	load_percent = (uint32_t)(used >= window ? 100 : (used * 100) / window);
+	load_window_start = busy;
+	load_window_tick = tick_count;
+	
+}
+#endif
+
+#ifdef SCHEDULER_INSTRUMENT
+const histogram_t *SCHEDULER_SwitchHistogram()
+{
+	
+	return &switch_cycles;
+	
+}
+
+const histogram_t *SCHEDULER_WakeHistogram()
+{
+	
+	return &wake_cycles;
+	
+}
+
+uint32_t SCHEDULER_HistogramMean(const histogram_t *histogram)
+{
+	
+	return histogram->count ? (uint32_t)(histogram->sum / histogram->count) : 0;
+	
+}
+
+void SCHEDULER_InstrumentReset()
+{
+	
+	INT_Disable();
+	
+	histogram_t *histograms[2] = { &switch_cycles, &wake_cycles };
+	uint32_t widths[2] = { SWITCH_BUCKET_WIDTH, WAKE_BUCKET_WIDTH };
+	
+	int i, j;
+	for (i = 0; i < 2; i++)
+	{
+		
+		histograms[i]->width = widths[i];
+		histograms[i]->count = 0;
+		histograms[i]->min = UINT32_MAX;
+		histograms[i]->max = 0;
+		histograms[i]->sum = 0;
+		
+		for (j = 0; j < HISTOGRAM_BUCKETS; j++)
+		{
+			histograms[i]->buckets[j] = 0;
+		}
+		
+	}
+	
+	for (i = 0; i < MAX_TASKS; i++)
+	{
+		wake_stamp[i] = 0;
+	}
+	
+	INT_Enable();
+	
+}
+
+/* must be called with interrupts disabled */
+static void SCHEDULER_HistogramAdd(histogram_t *histogram, uint32_t cycles)
+{
+	
+	uint32_t bucket = cycles / histogram->width;
+	
+	if (bucket >= HISTOGRAM_BUCKETS)
+	{
+		bucket = HISTOGRAM_BUCKETS - 1;
+	}
+	
+	histogram->buckets[bucket]++;
+	histogram->count++;
+	histogram->sum += cycles;
+	
+	if (cycles < histogram->min)
+	{
+		histogram->min = cycles;
+	}
+	
+	if (cycles > histogram->max)
+	{
+		histogram->max = cycles;
+	}
+	
+}
+#endif
+
+#ifdef SCHEDULER_STACK_PAINT
+/*
+ * Peak stack use of a task in bytes, found by scanning up from the bottom of
+ * its stack for the first word that no longer holds the paint value.
+ */
+uint32_t SCHEDULER_StackHighWater(task_t *task)
+{
+	
+	uint32_t *word = task->stack_start;
+	uint32_t *end = task->stack_start + task->stack_size / sizeof(uint32_t);
+	
+#ifdef SCHEDULER_MPU_GUARD
+	// the guard words are never used and may not be readable
+	word += MPU_GUARD_SIZE / sizeof(uint32_t);
+#endif
+	
+	while (word < end && *word == STACK_PAINT_WORD)
+	{
+		word++;
+	}
+	
+	return (uint32_t)(end - word) * sizeof(uint32_t);
+	
+}
+
+/*
+ * Fills report with the stack size and high-water mark of up to max tasks,
+ * returning how many entries were written.
+ */
+uint32_t SCHEDULER_StackReport(stack_usage_t *report, uint32_t max)
+{
+	
+	uint32_t count = 0;
+	
+	uint32_t i;
+	for (i = 0; i < MAX_TASKS && count < max; i++)
+	{
+		
+		if (task_table[i].flags & IN_USE_FLAG)
+		{
+			report[count].task = task_state[i].task;
+			report[count].size = task_state[i].task->stack_size;
+			report[count].used = SCHEDULER_StackHighWater(task_state[i].task);
+			count++;
+		}
+		
+	}
+	
+	return count;
+	
+}
+#endif
+
+#if defined(SCHEDULER_STACK_CHECK) || defined(SCHEDULER_MPU_GUARD)
+/*
+ * Called from the context switch or the MemManage fault, interrupts
+ * disabled, when a task has run past the bottom of its stack. Stops here by
+ * default; define it elsewhere to log or reset instead.
+ */
+__attribute__((weak)) void SCHEDULER_StackOverflow(task_t *task)
+{
+	
+	while(1);
+	
+}
+#endif
+
+#ifdef SCHEDULER_MPU_GUARD
+/*
+ * Only the running task's guard is mapped, so a MemManage fault means that
+ * task overflowed, whether on its own access or while its registers were
+ * being stacked.
+ */
+void MemManage_Handler()
+{
+	
+	SCHEDULER_StackOverflow(task_state[current_task].task);
+	
+}
+#endif
+
+uint32_t SCHEDULER_GetIdleTicks()
+{
+	
+	return idle_ticks;
+	
+}
+
+/*
+ * Runs whenever nothing else is ready. Hooks get one call per pass and must
+ * not block; after them the core sleeps until the next interrupt.
+ */
+static void SCHEDULER_IdleTask()
+{
+	
+	while (1)
+	{
+		
+		uint32_t i;
+		for (i = 0; i < idle_hook_count; i++)
+		{
+			idle_hooks[i]();
+		}
+		
+#ifdef SCHEDULER_TICKLESS
+		SCHEDULER_IdleSleep();
+#else
+		PORT_Idle();
+#endif
+		
+	}
+	
+}
+
+/* must be called with interrupts disabled */
+static void SCHEDULER_ReadyAdd(uint32_t id)
+{
+	
+	uint32_t priority = task_table[id].priority;
+	
+	ready_mask[priority] |= (1 << id);
+	priority_mask |= (1 << priority);
+	
+#ifdef SCHEDULER_EDF
+	if (priority == EDF_PRIORITY)
+	{
+		
+		uint32_t *link = &edf_head;
+		
+		while (*link != NO_TASK && (int32_t)(task_state[*link].deadline - task_state[id].deadline) <= 0)
+		{
+			link = &task_state[*link].edf_next;
+		}
+		
+		task_state[id].edf_next = *link;
+		*link = id;
+		
+	}
+#endif
+	
+}
+
+/* must be called with interrupts disabled */
+static void SCHEDULER_ReadyRemove(uint32_t id)
+{
+	
+	uint32_t priority = task_table[id].priority;
+	
+	ready_mask[priority] &= ~(1 << id);
+	
+	if (!ready_mask[priority])
+	{
+		priority_mask &= ~(1 << priority);
+	}
+	
+#ifdef SCHEDULER_EDF
+	if (priority == EDF_PRIORITY)
+	{
+		
+		uint32_t *link = &edf_head;
+		
+		while (*link != id)
+		{
+			link = &task_state[*link].edf_next;
+		}
+		
+		*link = task_state[id].edf_next;
+		
+	}
+#endif
+	
+}
+
+/*
+ * Picks the next runnable task in constant cycles: CLZ on priority_mask gives
+ * the highest priority with a ready task, then within that level the next
+ * task after current_task is taken round-robin by masking off the ready bits
+ * at or below it, falling back to the whole level if none are left, and taking
+ * the lowest set bit with RBIT + CLZ. The idle task is always ready, so there
+ * is always something to pick. With SCHEDULER_EDF the EDF_PRIORITY level is
+ * kept sorted by deadline instead and its head is taken.
+ */
+static uint32_t SCHEDULER_NextTask()
+{
+	
+	uint32_t priority = 31 - __CLZ(priority_mask);
+	
+#ifdef SCHEDULER_EDF
+	if (priority == EDF_PRIORITY)
+	{
+		return edf_head;
+	}
+#endif
+	
+	uint32_t ready = ready_mask[priority];
+	uint32_t after = ready & ~((2UL << current_task) - 1);
+	
+	if (after)
+	{
+		ready = after;
+	}
+	
+	return __CLZ(__RBIT(ready));
+	
+}
+
+uint32_t SCHEDULER_GetTicks()
+{
+	
+	return tick_count;
+	
+}
+
+#ifdef SCHEDULER_TICKLESS
+/*
+ * Called from the idle task. Stops SysTick and sleeps in EM2 until an
+ * interrupt or the RTC compare at the first sleeper's wakeup, then credits
+ * the ticks that were slept through and wakes the sleepers they cover.
+ * Interrupts are masked across the check so a release that lands just before
+ * the WFI still wakes the core; it is serviced once PRIMASK is restored.
+ */
+static void SCHEDULER_IdleSleep()
+{
+	
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	
+	if (priority_mask == (1 << IDLE_PRIORITY))
+	{
+		
+		uint32_t ticks = TICKLESS_MAX_IDLE;
+		
+		if (sleep_head != NO_TASK && task_state[sleep_head].delay < ticks)
+		{
+			ticks = task_state[sleep_head].delay;
+		}
+		
+#ifdef SCHEDULER_SWTIMER
+		if (SWTIMER_NextTick() < ticks)
+		{
+			ticks = SWTIMER_NextTick();
+		}
+		
+		if (ticks == 0)
+		{
+			ticks = 1;
+		}
+#endif
+		
+		uint32_t start = RTC_CounterGet();
+		uint32_t sleep = ((uint64_t)ticks * rtc_hz + tick_hz - 1) / tick_hz;
+		
+		if (sleep > (_RTC_CNT_MASK >> 1))
+		{
+			sleep = (_RTC_CNT_MASK >> 1);
+		}
+		
+		SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+		
+		RTC_CompareSet(0, (start + sleep) & _RTC_CNT_MASK);
+		RTC_IntClear(RTC_IF_COMP0);
+		RTC_IntEnable(RTC_IF_COMP0);
+		
+		EMU_EnterEM2(true);
+		SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+		
+		RTC_IntDisable(RTC_IF_COMP0);
+		
+		// convert rtc cycles slept into ticks, carrying the fraction over
+		uint64_t slept = (uint64_t)((RTC_CounterGet() - start) & _RTC_CNT_MASK) * tick_hz + rtc_remainder;
+		ticks = (uint32_t)(slept / rtc_hz);
+		rtc_remainder = (uint32_t)(slept % rtc_hz);
+		
+		tick_count += ticks;
+		idle_ticks += ticks;
+		
+		// restart the tick first: a due timer's EventSignal can unmask
+		// interrupts and switch away before this function returns
+		SysTick->VAL = 0;
+		SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+		
+		SCHEDULER_SleepAdvance(ticks);
+#ifdef SCHEDULER_SWTIMER
+		SWTIMER_Tick();
+#endif
+		
+	}
+	
+	__set_PRIMASK(primask);
+	
+}
+
+void RTC_IRQHandler()
+{
+	
+	RTC_IntClear(RTC_IF_COMP0);
+	
+}
+#endif
+
+void SysTick_Handler()
+{
+	
+#ifdef SCHEDULER_TRACE
+	TRACE_IsrEnter();
+#endif
+	
+	tick_count++;
+	
+	if (current_task == idle_task_id)
+	{
+		idle_ticks++;
+	}
+	
+	INT_Disable();
+	SCHEDULER_SleepAdvance(1);
+#ifdef SCHEDULER_SWTIMER
+	SWTIMER_Tick();
+#endif
+#ifdef SCHEDULER_EDF
+	SCHEDULER_DeadlineCheck();
+#endif
+#ifdef SCHEDULER_BUDGET
+	SCHEDULER_BudgetCharge();
+#endif
+#ifdef SCHEDULER_STATS
+	if (tick_count - load_window_tick >= LOAD_WINDOW)
+	{
+		SCHEDULER_StatsLoad();
+	}
+#endif
+	INT_Enable();
+	
+	// end of the quantum, the switch itself happens in PendSV and starts the next one
+	if (slice_left > 1)
+	{
+		slice_left--;
+	}
+	else
+	{
+		SCHEDULER_PendSwitch();
+	}
+	
+#ifdef SCHEDULER_TRACE
+	TRACE_IsrExit();
+#endif
+	
+}
+
+/*
+ * Called from the port's switch with interrupts disabled. Records the outgoing
+ * task's saved context (0 on the very first switch out of main) and returns
+ * the context of the task to resume. entry_cycles is the cycle count the port
+ * took before saving any registers, only read with SCHEDULER_INSTRUMENT.
+ */
+void *SCHEDULER_Switch(void *sp, uint32_t entry_cycles)
+{
+	
+	if (sp)
+	{
+		
+		task_table[current_task].stack = sp;
+		
+#if defined(SCHEDULER_STACK_CHECK) && !defined(SCHEDULER_MPU_GUARD)
+		// the lowest word of every stack holds the paint value until overrun
+		if (task_state[current_task].task->stack_start[0] != STACK_PAINT_WORD)
+		{
+			SCHEDULER_StackOverflow(task_state[current_task].task);
+		}
+#endif
+		
+	}
+	
+	uint32_t previous = current_task;
+	
+	current_task = SCHEDULER_NextTask();
+	slice_left = task_state[current_task].quantum;
+	
+#ifdef SCHEDULER_STATS
+	if (current_task != previous)
+	{
+		SCHEDULER_StatsSwitch(previous, sp != 0);
+	}
+#endif
+	
+#ifdef SCHEDULER_TRACE
+	if (current_task != previous || !sp)
+	{
+		TRACE_Record(TRACE_SWITCH, current_task, sp ? previous : TRACE_NO_TASK);
+	}
+#endif
+	
+	// nothing runs on an exited task's stack anymore, so it can be reused
+	if (task_table[previous].flags & EXIT_FLAG)
+	{
+		SCHEDULER_TaskRelease(previous);
+	}
+	
+#ifdef SCHEDULER_MPU_GUARD
+	// move the guard under the incoming stack, a single RBAR write
+	MPU->RBAR = (uint32_t)task_state[current_task].task->stack_start | MPU_RBAR_VALID_Msk | MPU_GUARD_REGION;
+#endif
+	
+#ifdef SCHEDULER_INSTRUMENT
+	uint32_t end = DWT_CycleCount();
+	
+	if (wake_stamp[current_task])
+	{
+		SCHEDULER_HistogramAdd(&wake_cycles, end - wake_stamp[current_task]);
+		wake_stamp[current_task] = 0;
+	}
+	
+	SCHEDULER_HistogramAdd(&switch_cycles, end - entry_cycles);
+#endif
+	
+	return task_table[current_task].stack;
 	
 }
@@ -6,61 +6,271 @@
 
 #define IN_USE_FLAG				0x00000001
 #define EXEC_FLAG					0x00000002
+#define SLEEP_FLAG				0x00000004 // in the delta list, sleeping or waiting with a timeout
+#define PERIODIC_FLAG			0x00000008 // scheduled by deadline, see SCHEDULER_TaskInitPeriodic
+#define EXIT_FLAG					0x00000010 // exited, slot freed by the switch away from it
 
 #define MAX_TASKS 				32
-#define TASK_STACK_SIZE 	1024
+#define NO_TASK 					MAX_TASKS // end of a task list
+#define WAIT_FOREVER 			0xFFFFFFFF
+#define PRIORITY_LEVELS 	8 // 0 = lowest
+#define IDLE_PRIORITY 		0 // reserved for the idle task
+#define IDLE_HOOKS_MAX 		4
+#ifdef SCHEDULER_HOSTED
+#define TASK_STACK_SIZE 	65536 // signal frames and libc calls land on task stacks
+#define IDLE_STACK_SIZE 	65536
+#else
+#define TASK_STACK_SIZE 	1024 // default for SCHEDULER_TASK_DEFINE
+#define IDLE_STACK_SIZE 	256
+#endif
 #define TASK_DURATION 		240000 // ~ 5ms (200hz)
+#define DEFAULT_QUANTUM 		1 // ticks a task runs before others at its priority get a turn
 
-typedef struct 
+// #define SCHEDULER_TICKLESS // stop SysTick and sleep in EM2 on the RTC when idle
+#define TICKLESS_MAX_IDLE 	(60 * 200) // longest single EM2 sleep in ticks (~60s)
+// #define SCHEDULER_STACK_PAINT // fill stacks at TaskInit so their high-water mark can be read
+// #define SCHEDULER_STACK_CHECK // check each outgoing task's stack canary on every switch
+#define STACK_PAINT_WORD 	0xDEADBEEF
+// #define SCHEDULER_MPU_GUARD // no-access MPU region over the bottom of the running task's stack
+#define MPU_GUARD_REGION 	7
+#define MPU_GUARD_SIZE 		32
+
+#ifdef SCHEDULER_MPU_GUARD
+#define STACK_ALIGN 			MPU_GUARD_SIZE // the guard region must be aligned to its size
+#else
+#define STACK_ALIGN 			8
+#endif
+// #define SCHEDULER_INSTRUMENT // time switches and wakeup latency with the DWT cycle counter
+#define HISTOGRAM_BUCKETS 	16
+#define SWITCH_BUCKET_WIDTH 	32 // cycles
+#define WAKE_BUCKET_WIDTH 	256 // cycles
+// #define SCHEDULER_STATS // per-task CPU time and switch counts from the DWT cycle counter
+// costs ~2 cycles per switch in bench-hosted (median of 30 runs, min 15 -> 17-18), not yet measured on target
+#define LOAD_WINDOW 			200 // ticks per CPU load sample (~1s)
+// #define SCHEDULER_TRACE // binary event trace over SWO or into a RAM ring, see trace.c
+// SCHEDULER_HOSTED builds for Linux with posix/port_posix.c instead, see 'make hosted'
+// #define SCHEDULER_EDF // earliest deadline first for periodic tasks, ahead of every fixed priority
+#define EDF_PRIORITY 			(PRIORITY_LEVELS - 1) // level the periodic tasks run at, not for TaskInit
+#define EDF_SCALE 			65536 // fixed point density of 1.0 for the admission test
+// #define SCHEDULER_BUDGET // per-task CPU budgets, tasks that overrun theirs are throttled
+// #define SCHEDULER_TASK_POOL // SCHEDULER_TaskSpawn runs short-lived tasks on pooled stacks
+#define TASK_POOL_SIZE 		4 // tasks spawned at once, at most 32
+#define TASK_POOL_STACK_SIZE 	TASK_STACK_SIZE
+// #define SCHEDULER_SWTIMER // drive the software timer wheel in swtimer.c from the tick
+
+typedef struct
 {
 	
-	uint32_t r0;
-	uint32_t r1;
-	uint32_t r2;
-	uint32_t r3;
-	uint32_t r12;
-	uint32_t lr;
-	uint32_t pc;
-	uint32_t psr;
+	uint32_t *stack_start;
+	uint32_t stack_size; // bytes
 	
-} hw_stack_frame_t;
+} task_t;
 
-typedef struct 
-{
+// defines task_t name with its own stack_bytes stack, rounded up to STACK_ALIGN
+#define SCHEDULER_TASK_DEFINE(name, stack_bytes) \
+	static uint32_t name##_stack[(((stack_bytes) + STACK_ALIGN - 1) / STACK_ALIGN) * (STACK_ALIGN / 4)] __attribute__((aligned(STACK_ALIGN))); \
+	task_t name = { name##_stack, sizeof(name##_stack) }
 
-	uint32_t r4;
-	uint32_t r5;
-	uint32_t r6;
-	uint32_t r7;
-	uint32_t r8;
-	uint32_t r9;
-	uint32_t r10;
-	uint32_t r11;
+// an entry of the const task table SCHEDULER_Init starts tasks from
+typedef struct
+{
 	
-} sw_stack_frame_t;
+	task_t *task;
+	void *entry_point;
+	uint32_t priority;
+	
+} task_descriptor_t;
+
+// defines task_t name as SCHEDULER_TASK_DEFINE does and puts a descriptor for
+// it in the scheduler_tasks section, so SCHEDULER_Init starts it without a
+// SCHEDULER_TaskInit call
+#define SCHEDULER_TASK_STATIC(name, entry_point, priority, stack_bytes) \
+	SCHEDULER_TASK_DEFINE(name, stack_bytes); \
+	static const task_descriptor_t name##_descriptor __attribute__((section("scheduler_tasks"), used, aligned(4))) = { &name, (void*)(entry_point), (priority) }
+
+struct mutex;
+struct event;
 
 typedef struct
 {
 	
-	uint8_t stack_start[TASK_STACK_SIZE];
-	void *stack;
-	sw_stack_frame_t sw_stack_frame;
+	task_t *task;
+	uint32_t priority;
+	uint64_t run_cycles; // including interrupts taken while it ran
+	uint64_t blocked_cycles; // from blocking until woken
+	uint32_t switches; // times switched in
+	uint32_t yields; // gave up the CPU by blocking or SCHEDULER_Yield
+	uint32_t preemptions; // switched out while still ready
+	uint32_t overruns; // throttled for using up its budget, SCHEDULER_BUDGET only
 	
-} task_t;
+} task_stats_t;
 
+// hot fields touched by every switch, kept apart from the rest
 typedef struct
 {
 	
-	task_t *task;
+	void *stack; // saved process stack pointer, r4-r11 on top
 	uint32_t flags;
+	uint32_t priority; // effective, raised while a mutex holder inherits
 	
 } task_table_t;
 
+typedef struct
+{
+	
+	task_t *task;
+	uint32_t base_priority;
+	uint32_t delay; // ticks after the previous sleeper in the delta list
+	uint32_t sleep_next;
+	uint32_t wait_bits; // bits waited for, then the bits that woke the task
+	uint32_t wait_next;
+	struct event *wait_list; // wait list the task is queued on, if any
+	void *msg; // message handed over by a queue
+	struct mutex *wait_mutex; // mutex the task is blocked on, if any
+	uint32_t mutexes_held;
+	uint32_t quantum; // ticks per turn at its priority
+#ifdef SCHEDULER_BUDGET
+	uint32_t budget; // ticks per budget_period, 0 = unlimited
+	uint32_t budget_period;
+	uint32_t budget_used; // ticks charged since replenish_tick
+	uint32_t replenish_tick;
+	uint32_t overruns;
+#endif
+#ifdef SCHEDULER_STATS
+	task_stats_t stats;
+	uint32_t blocked_at; // cycle count when it blocked, 0 if it has not
+	uint32_t yielded; // set by SCHEDULER_Yield until the next switch
+#endif
+#ifdef SCHEDULER_EDF
+	uint32_t period; // ticks between releases, 0 for fixed-priority tasks
+	uint32_t relative_deadline;
+	uint32_t density; // wcet / min(deadline, period) in 1/EDF_SCALE
+	uint32_t release; // tick the current job was released
+	uint32_t deadline; // absolute, orders the EDF_PRIORITY level
+	uint32_t deadline_misses;
+	bool missed; // current job already counted in deadline_misses
+	uint32_t edf_next;
+#endif
+	
+} task_state_t;
+
+typedef struct event
+{
+	
+	uint32_t head; // first waiting task, NO_TASK if none
+	uint32_t tail;
+	
+} event_t;
+
+typedef struct
+{
+	
+	volatile uint32_t count;
+	event_t waiters;
+	
+} semaphore_t;
+
+typedef struct mutex
+{
+	
+	volatile uint32_t owner; // owning task id + 1, 0 when free
+	event_t waiters;
+	
+} mutex_t;
+
+typedef struct
+{
+	
+	void **slots;
+	uint32_t capacity;
+	uint32_t count;
+	uint32_t head; // oldest message
+	event_t receivers;
+	event_t senders;
+	
+} queue_t;
+
+typedef void (*idle_hook_t)();
+
+typedef struct
+{
+	
+	uint32_t width; // cycles per bucket
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t buckets[HISTOGRAM_BUCKETS]; // the last one also takes everything beyond
+	
+} histogram_t;
+
+typedef struct
+{
+	
+	task_t *task;
+	uint32_t size; // bytes
+	uint32_t used; // high-water mark in bytes
+	
+} stack_usage_t;
+
 void SCHEDULER_Init();
-bool SCHEDULER_TaskInit(task_t *task, void *entry_point);
+bool SCHEDULER_TaskInit(task_t *task, void *entry_point, uint32_t priority);
+void SCHEDULER_TaskExit();
+bool SCHEDULER_TaskDelete(task_t *task);
+bool SCHEDULER_TaskJoin(task_t *task, uint32_t timeout);
+#ifdef SCHEDULER_TASK_POOL
+task_t *SCHEDULER_TaskSpawn(void *entry_point, uint32_t priority);
+#endif
 void SCHEDULER_Run();
 void SCHEDULER_Wait(uint32_t flags);
 void SCHEDULER_Release(uint32_t flags);
 void SCHEDULER_Yield();
+void SCHEDULER_EventInit(event_t *event);
+uint32_t SCHEDULER_EventWait(event_t *event, uint32_t bits);
+uint32_t SCHEDULER_EventWaitTimeout(event_t *event, uint32_t bits, uint32_t timeout);
+void SCHEDULER_EventSignal(event_t *event, uint32_t bits);
+void SCHEDULER_SemInit(semaphore_t *sem, uint32_t count);
+void SCHEDULER_SemTake(semaphore_t *sem);
+bool SCHEDULER_SemTryTake(semaphore_t *sem);
+void SCHEDULER_SemGive(semaphore_t *sem);
+void SCHEDULER_MutexInit(mutex_t *mutex);
+void SCHEDULER_MutexLock(mutex_t *mutex);
+bool SCHEDULER_MutexTryLock(mutex_t *mutex);
+void SCHEDULER_MutexUnlock(mutex_t *mutex);
+bool SCHEDULER_QueueInit(queue_t *queue, void **slots, uint32_t capacity);
+bool SCHEDULER_QueueSend(queue_t *queue, void *msg, uint32_t timeout);
+bool SCHEDULER_QueueReceive(queue_t *queue, void **msg, uint32_t timeout);
+void SCHEDULER_Sleep(uint32_t ticks);
+void SCHEDULER_SleepUntil(uint32_t tick);
+uint32_t SCHEDULER_GetTicks();
+uint32_t SCHEDULER_GetIdleTicks();
+bool SCHEDULER_IdleHookAdd(idle_hook_t hook);
+bool SCHEDULER_SetQuantum(task_t *task, uint32_t ticks);
+#ifdef SCHEDULER_BUDGET
+bool SCHEDULER_SetBudget(task_t *task, uint32_t budget, uint32_t period);
+uint32_t SCHEDULER_Overruns(task_t *task);
+#endif
+#ifdef SCHEDULER_EDF
+bool SCHEDULER_TaskInitPeriodic(task_t *task, void *entry_point, uint32_t wcet, uint32_t period, uint32_t deadline);
+void SCHEDULER_WaitNextPeriod();
+uint32_t SCHEDULER_DeadlineMisses(task_t *task);
+#endif
+#ifdef SCHEDULER_STATS
+uint32_t SCHEDULER_GetStats(task_stats_t *stats, uint32_t max);
+uint32_t SCHEDULER_GetLoad();
+#endif
+#ifdef SCHEDULER_INSTRUMENT
+const histogram_t *SCHEDULER_SwitchHistogram();
+const histogram_t *SCHEDULER_WakeHistogram();
+uint32_t SCHEDULER_HistogramMean(const histogram_t *histogram);
+void SCHEDULER_InstrumentReset();
+#endif
+#ifdef SCHEDULER_STACK_PAINT
+uint32_t SCHEDULER_StackHighWater(task_t *task);
+uint32_t SCHEDULER_StackReport(stack_usage_t *report, uint32_t max);
+#endif
+#if defined(SCHEDULER_STACK_CHECK) || defined(SCHEDULER_MPU_GUARD)
+void SCHEDULER_StackOverflow(task_t *task);
+#endif
 
 #endif
\ No newline at end of file
@@ -0,0 +1,454 @@
+#include "swtimer.h"
+
+#include "efm32.h"
+#include "efm32_int.h"
+
+#include "scheduler.h"
+
+#define SWTIMER_SLOT_MASK 	(SWTIMER_SLOTS - 1)
+#define SWTIMER_EXPIRED 		(SWTIMER_LEVELS * SWTIMER_SLOTS)
+
+/* variables */
+static swtimer_t *wheel[SWTIMER_LEVELS][SWTIMER_SLOTS];
+static uint64_t occupied[SWTIMER_LEVELS]; // bit n set = wheel[level][n] not empty
+static swtimer_t *expired; // due timers waiting for their callback
+static uint32_t wheel_tick; // last tick the wheel has been advanced to
+static volatile uint32_t next_due; // next tick the service task has work at
+static volatile uint32_t active = 0;
+SCHEDULER_TASK_DEFINE(swtimer_task, SWTIMER_STACK_SIZE);
+static event_t swtimer_event;
+
+/* prototypes */
+static void SWTIMER_Task();
+static void SWTIMER_Link(swtimer_t **head, swtimer_t *timer);
+static void SWTIMER_Unlink(swtimer_t *timer);
+static void SWTIMER_Insert(swtimer_t *timer);
+static void SWTIMER_Cascade();
+static void SWTIMER_Advance(uint32_t now);
+static uint32_t SWTIMER_NextEvent();
+static uint32_t SWTIMER_NextExpiry();
+
+/*
+ * Software timers on a hierarchical timer wheel: SWTIMER_LEVELS wheels of
+ * SWTIMER_SLOTS slots each, level n covering delays of up to
+ * SWTIMER_SLOTS^(n+1) ticks. Starting and stopping a timer links or unlinks
+ * it from one slot; when a lower wheel wraps, the matching slot of the wheel
+ * above is cascaded down. Callbacks run in the service task, not in SysTick.
+ */
+
+/* functions */
+bool SWTIMER_Init(uint32_t priority)
+{
+	
+	int level, slot;
+	for (level = 0; level < SWTIMER_LEVELS; level++)
+	{
+		
+		for (slot = 0; slot < SWTIMER_SLOTS; slot++)
+		{
+			wheel[level][slot] = 0;
+		}
+		
+		occupied[level] = 0;
+		
+	}
+	
+	expired = 0;
+	active = 0;
+	wheel_tick = SCHEDULER_GetTicks();
+	next_due = wheel_tick;
+	SCHEDULER_EventInit(&swtimer_event);
+	
+	return SCHEDULER_TaskInit(&swtimer_task, SWTIMER_Task, priority);
+	
+}
+
+void SWTIMER_Create(swtimer_t *timer, swtimer_callback_t callback, void *arg)
+{
+	
+	timer->next = 0;
+	timer->pprev = 0;
+	timer->period = 0;
+	timer->callback = callback;
+	timer->arg = arg;
+	
+}
+
+/*
+ * (Re)arms a timer to fire delay ticks from now, then every period ticks if
+ * period is not 0. Safe to call from interrupts.
+ */
+void SWTIMER_Start(swtimer_t *timer, uint32_t delay, uint32_t period)
+{
+	
+	if (delay == 0)
+	{
+		delay = 1;
+	}
+	else if (delay > SWTIMER_MAX_DELAY)
+	{
+		delay = SWTIMER_MAX_DELAY;
+	}
+	
+	if (period > SWTIMER_MAX_DELAY)
+	{
+		period = SWTIMER_MAX_DELAY;
+	}
+	
+	INT_Disable();
+	
+	if (timer->pprev)
+	{
+		SWTIMER_Unlink(timer);
+	}
+	else
+	{
+		active++;
+	}
+	
+	timer->expiry = SCHEDULER_GetTicks() + delay;
+	timer->period = period;
+	SWTIMER_Insert(timer);
+	
+	next_due = SWTIMER_NextEvent();
+	SWTIMER_Tick();
+	
+	INT_Enable();
+	
+}
+
+void SWTIMER_Stop(swtimer_t *timer)
+{
+	
+	INT_Disable();
+	
+	if (timer->pprev)
+	{
+		SWTIMER_Unlink(timer);
+		active--;
+	}
+	
+	INT_Enable();
+	
+}
+
+bool SWTIMER_IsActive(swtimer_t *timer)
+{
+	
+	return timer->pprev != 0;
+	
+}
+
+/*
+ * Called by the scheduler on every tick with interrupts disabled; wakes the
+ * service task once the wheel has work due.
+ */
+void SWTIMER_Tick()
+{
+	
+	if (active && (int32_t)(SCHEDULER_GetTicks() - next_due) >= 0)
+	{
+		SCHEDULER_EventSignal(&swtimer_event, 1);
+	}
+	
+}
+
+/*
+ * Ticks until the earliest timer comes due, on any level, used to bound
+ * tickless sleep. Wraps and cascades on the way need no wakeup, the service
+ * task catches up on them when it next runs. Called with interrupts disabled.
+ */
+uint32_t SWTIMER_NextTick()
+{
+	
+	if (!active)
+	{
+		return UINT32_MAX;
+	}
+	
+	if (expired)
+	{
+		return 0;
+	}
+	
+	int32_t ticks = (int32_t)(SWTIMER_NextExpiry() - SCHEDULER_GetTicks());
+	
+	return ticks > 0 ? ticks : 0;
+	
+}
+
+static void SWTIMER_Task()
+{
+	
+	while (1)
+	{
+		
+		INT_Disable();
+		
+		SWTIMER_Advance(SCHEDULER_GetTicks());
+		
+		while (expired)
+		{
+			
+			swtimer_t *timer = expired;
+			SWTIMER_Unlink(timer);
+			
+			if (timer->period)
+			{
+				
+				timer->expiry += timer->period;
+				
+				// fell behind by more than a period, skip the missed runs
+				if ((int32_t)(timer->expiry - wheel_tick) <= 0)
+				{
+					timer->expiry = wheel_tick + 1;
+				}
+				
+				SWTIMER_Insert(timer);
+				
+			}
+			else
+			{
+				active--;
+			}
+			
+			// the callback may restart or stop any timer, this one included
+			INT_Enable();
+			timer->callback(timer->arg);
+			INT_Disable();
+			
+		}
+		
+		next_due = SWTIMER_NextEvent();
+		
+		if (!active || (int32_t)(SCHEDULER_GetTicks() - next_due) < 0)
+		{
+			SCHEDULER_EventWait(&swtimer_event, 1);
+		}
+		
+		INT_Enable();
+		
+	}
+	
+}
+
+/* list helpers, must be called with interrupts disabled */
+static void SWTIMER_Link(swtimer_t **head, swtimer_t *timer)
+{
+	
+	timer->next = *head;
+	
+	if (timer->next)
+	{
+		timer->next->pprev = &timer->next;
+	}
+	
+	*head = timer;
+	timer->pprev = head;
+	
+}
+
+static void SWTIMER_Unlink(swtimer_t *timer)
+{
+	
+	*timer->pprev = timer->next;
+	
+	if (timer->next)
+	{
+		timer->next->pprev = timer->pprev;
+	}
+	
+	if (timer->slot != SWTIMER_EXPIRED)
+	{
+		
+		uint32_t level = timer->slot / SWTIMER_SLOTS;
+		uint32_t slot = timer->slot % SWTIMER_SLOTS;
+		
+		if (!wheel[level][slot])
+		{
+			occupied[level] &= ~(1ULL << slot);
+		}
+		
+	}
+	
+	timer->next = 0;
+	timer->pprev = 0;
+	
+}
+
+/*
+ * Files a timer in the lowest level whose range covers its delay from
+ * wheel_tick, in the slot for its expiry at that level.
+ */
+static void SWTIMER_Insert(swtimer_t *timer)
+{
+	
+	uint32_t delta = timer->expiry - wheel_tick;
+	uint32_t level = 0;
+	
+	while (level < SWTIMER_LEVELS - 1 && delta >= (1UL << (SWTIMER_SLOT_BITS * (level + 1))))
+	{
+		level++;
+	}
+	
+	uint32_t slot = (timer->expiry >> (SWTIMER_SLOT_BITS * level)) & SWTIMER_SLOT_MASK;
+	
+	timer->slot = level * SWTIMER_SLOTS + slot;
+	SWTIMER_Link(&wheel[level][slot], timer);
+	occupied[level] |= (1ULL << slot);
+	
+}
+
+/*
+ * Called when wheel_tick has just wrapped level 0. Re-files the current slot
+ * of every level that wrapped with it, highest first, so their timers drop
+ * into the lower levels before those are processed.
+ */
+static void SWTIMER_Cascade()
+{
+	
+	uint32_t level = 1;
+	
+	while (level < SWTIMER_LEVELS - 1 && !((wheel_tick >> (SWTIMER_SLOT_BITS * level)) & SWTIMER_SLOT_MASK))
+	{
+		level++;
+	}
+	
+	for (; level > 0; level--)
+	{
+		
+		uint32_t slot = (wheel_tick >> (SWTIMER_SLOT_BITS * level)) & SWTIMER_SLOT_MASK;
+		swtimer_t *timer = wheel[level][slot];
+		
+		wheel[level][slot] = 0;
+		occupied[level] &= ~(1ULL << slot);
+		
+		while (timer)
+		{
+			
+			swtimer_t *next = timer->next;
+			SWTIMER_Insert(timer);
+			timer = next;
+			
+		}
+		
+	}
+	
+}
+
+/*
+ * Brings the wheel up to now, jumping straight between occupied level 0 slots
+ * and wrap points, and moves every timer that came due onto the expired list.
+ */
+static void SWTIMER_Advance(uint32_t now)
+{
+	
+	while ((int32_t)(now - wheel_tick) > 0)
+	{
+		
+		uint32_t next = SWTIMER_NextEvent();
+		
+		if (!active || (int32_t)(now - next) < 0)
+		{
+			wheel_tick = now;
+			break;
+		}
+		
+		wheel_tick = next;
+		
+		if (!(wheel_tick & SWTIMER_SLOT_MASK))
+		{
+			SWTIMER_Cascade();
+		}
+		
+		uint32_t slot = wheel_tick & SWTIMER_SLOT_MASK;
+		swtimer_t *timer = wheel[0][slot];
+		
+		wheel[0][slot] = 0;
+		occupied[0] &= ~(1ULL << slot);
+		
+		while (timer)
+		{
+			
+			swtimer_t *next = timer->next;
+			timer->slot = SWTIMER_EXPIRED;
+			SWTIMER_Link(&expired, timer);
+			timer = next;
+			
+		}
+		
+	}
+	
+}
+
+/*
+ * Next tick after wheel_tick with anything to do: the next occupied level 0
+ * slot in this rotation, or else the next wrap of level 0.
+ */
+static uint32_t SWTIMER_NextEvent()
+{
+	
+	uint32_t index = wheel_tick & SWTIMER_SLOT_MASK;
+	uint64_t later = 0;
+	
+	if (index < SWTIMER_SLOT_MASK)
+	{
+		later = occupied[0] & (~0ULL << (index + 1));
+	}
+	
+	if (later)
+	{
+		return (wheel_tick & ~SWTIMER_SLOT_MASK) + __builtin_ctzll(later);
+	}
+	
+	return (wheel_tick | SWTIMER_SLOT_MASK) + 1;
+	
+}
+
+/*
+ * Earliest expiry of any timer on the wheel. Within a level the slots cover
+ * consecutive ranges starting after the current one, so the first occupied
+ * slot in that order holds the level's earliest timer; only that slot's list
+ * is scanned. The current slot itself comes last, anything filed there is a
+ * full rotation ahead.
+ */
+static uint32_t SWTIMER_NextExpiry()
+{
+	
+	uint32_t earliest = UINT32_MAX; // as a delta from wheel_tick
+	
+	uint32_t level;
+	for (level = 0; level < SWTIMER_LEVELS; level++)
+	{
+		
+		if (!occupied[level])
+		{
+			continue;
+		}
+		
+		uint32_t index = (wheel_tick >> (SWTIMER_SLOT_BITS * level)) & SWTIMER_SLOT_MASK;
+		uint64_t later = 0;
+		
+		if (index < SWTIMER_SLOT_MASK)
+		{
+			later = occupied[level] & (~0ULL << (index + 1));
+		}
+		
+		uint32_t slot = __builtin_ctzll(later ? later : occupied[level]);
+		swtimer_t *timer;
+		
+		for (timer = wheel[level][slot]; timer; timer = timer->next)
+		{
+			
+			if (timer->expiry - wheel_tick < earliest)
+			{
+				earliest = timer->expiry - wheel_tick;
+			}
+			
+		}
+		
+	}
+	
+	return wheel_tick + earliest;
+	
+}
\ No newline at end of file
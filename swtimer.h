@@ -0,0 +1,40 @@
+#ifndef __SWTIMER_H__
+#define __SWTIMER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SWTIMER_LEVELS 		4
+#define SWTIMER_SLOT_BITS 	6
+#define SWTIMER_SLOTS 		(1 << SWTIMER_SLOT_BITS)
+#ifdef SCHEDULER_HOSTED
+#define SWTIMER_STACK_SIZE 	65536
+#else
+#define SWTIMER_STACK_SIZE 	1024 // service task stack, callbacks run on it
+#endif
+#define SWTIMER_MAX_DELAY 	((1UL << (SWTIMER_LEVELS * SWTIMER_SLOT_BITS)) - 1) // ~23h at 200hz
+
+typedef void (*swtimer_callback_t)(void *arg);
+
+typedef struct swtimer
+{
+
+	struct swtimer *next;
+	struct swtimer **pprev; // link pointing at this timer, NULL when inactive
+	uint32_t slot; // level * SWTIMER_SLOTS + slot in that level
+	uint32_t expiry; // absolute tick
+	uint32_t period; // 0 = one-shot
+	swtimer_callback_t callback;
+	void *arg;
+
+} swtimer_t;
+
+bool SWTIMER_Init(uint32_t priority);
+void SWTIMER_Create(swtimer_t *timer, swtimer_callback_t callback, void *arg);
+void SWTIMER_Start(swtimer_t *timer, uint32_t delay, uint32_t period);
+void SWTIMER_Stop(swtimer_t *timer);
+bool SWTIMER_IsActive(swtimer_t *timer);
+void SWTIMER_Tick();
+uint32_t SWTIMER_NextTick();
+
+#endif
\ No newline at end of file
@@ -3,8 +3,10 @@
 
 #include "scheduler.h"
 
+#define RADIO_TASK_PRIORITY 4
+
 /* tasks */
-task_t radio_task;
+extern task_t radio_task;
 
 /* entry points */
 void radio_task_entrypoint();
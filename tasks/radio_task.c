@@ -3,16 +3,17 @@
 
 #include "led.h"
 
-task_t radio_task;
+#define RADIO_BLINK_TICKS 	50 // ~ 250ms at 200hz
+
+SCHEDULER_TASK_STATIC(radio_task, radio_task_entrypoint, RADIO_TASK_PRIORITY, TASK_STACK_SIZE);
 
 void radio_task_entrypoint()
 {
 	
-	int i;
 	LED_On(RED);
 	while(1)
 	{
-		for (i = 0; i < 2000000; i++);
+		SCHEDULER_Sleep(RADIO_BLINK_TICKS);
 		LED_Toggle(RED);
 	}
 	
@@ -0,0 +1,424 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "trace.h"
+
+/*
+ * Host side decoder for trace.c. Reads either a raw SWO capture (ITM
+ * packets, records taken from stimulus port TRACE_ITM_PORT) or a dump of
+ * trace_ring, and writes Chrome trace JSON to stdout, viewable in
+ * chrome://tracing or Perfetto. Tasks show up as threads of process 1,
+ * interrupts as threads of process 2.
+ *
+ * usage: tracedecode [-f core_hz] [-p port] file > trace.json
+ */
+
+#define MAX_THREADS 		256
+
+/* variables */
+static double cycles_per_us = 48.0;
+static uint32_t itm_port = TRACE_ITM_PORT;
+static uint64_t last_time = 0;
+static uint32_t running = TRACE_NO_TASK;
+static bool task_open[MAX_THREADS];
+static bool task_seen[MAX_THREADS];
+static bool isr_seen[MAX_THREADS];
+static uint32_t isr_depth[MAX_THREADS];
+static bool first_event = true;
+
+/* prototypes */
+static uint8_t *ReadFile(const char *path, size_t *length);
+static size_t ParseItm(const uint8_t *data, size_t length, uint8_t *out);
+static void Decode(const uint8_t *data, size_t count);
+static void Event(const char *name, char phase, uint32_t pid, uint32_t tid, uint64_t time, const char *args);
+static void NameThread(uint32_t pid, uint32_t tid, const char *name);
+static void SeeTask(uint32_t task);
+static void DecodeRecord(const trace_record_t *record);
+
+/* functions */
+int main(int argc, char **argv)
+{
+	
+	const char *path = 0;
+	
+	int i;
+	for (i = 1; i < argc; i++)
+	{
+		
+		if (!strcmp(argv[i], "-f") && i + 1 < argc)
+		{
+			cycles_per_us = atof(argv[++i]) / 1e6;
+		}
+		else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+		{
+			itm_port = atoi(argv[++i]);
+		}
+		else
+		{
+			path = argv[i];
+		}
+		
+	}
+	
+	if (!path || cycles_per_us <= 0)
+	{
+		fprintf(stderr, "usage: %s [-f core_hz] [-p port] file > trace.json\n", argv[0]);
+		return 2;
+	}
+	
+	size_t length;
+	uint8_t *data = ReadFile(path, &length);
+	
+	if (!data)
+	{
+		perror(path);
+		return 1;
+	}
+	
+	printf("{\"traceEvents\":[\n");
+	
+	trace_ring_t ring;
+	
+	if (length >= 12 && ((const uint32_t*)data)[0] == TRACE_MAGIC)
+	{
+		
+		// dump of trace_ring, oldest record first
+		memcpy(&ring, data, 12);
+		
+		uint32_t count = ring.head < ring.size ? ring.head : ring.size;
+		uint32_t first = ring.head - count;
+		
+		if (ring.size == 0 || (ring.size & (ring.size - 1)) || length < 12 + (size_t)ring.size * sizeof(trace_record_t))
+		{
+			fprintf(stderr, "%s: truncated or corrupt ring dump\n", path);
+			return 1;
+		}
+		
+		const trace_record_t *records = (const trace_record_t*)(data + 12);
+		
+		uint32_t n;
+		for (n = 0; n < count; n++)
+		{
+			DecodeRecord(&records[(first + n) & (ring.size - 1)]);
+		}
+		
+	}
+	else
+	{
+		
+		uint8_t *payload = malloc(length);
+		size_t count = ParseItm(data, length, payload);
+		
+		if (count % sizeof(trace_record_t))
+		{
+			fprintf(stderr, "%s: %u trailing bytes ignored\n", path, (unsigned)(count % sizeof(trace_record_t)));
+		}
+		
+		Decode(payload, count / sizeof(trace_record_t));
+		free(payload);
+		
+	}
+	
+	// close whatever is still running at the end of the capture
+	if (running != TRACE_NO_TASK && task_open[running])
+	{
+		Event("run", 'E', 1, running, last_time, 0);
+	}
+	
+	printf("\n]}\n");
+	
+	free(data);
+	return 0;
+	
+}
+
+static uint8_t *ReadFile(const char *path, size_t *length)
+{
+	
+	FILE *file = fopen(path, "rb");
+	
+	if (!file)
+	{
+		return 0;
+	}
+	
+	size_t size = 0;
+	size_t capacity = 4096;
+	uint8_t *data = malloc(capacity);
+	size_t got;
+	
+	while ((got = fread(data + size, 1, capacity - size, file)) > 0)
+	{
+		
+		size += got;
+		
+		if (size == capacity)
+		{
+			capacity *= 2;
+			data = realloc(data, capacity);
+		}
+		
+	}
+	
+	fclose(file);
+	
+	*length = size;
+	return data;
+	
+}
+
+/*
+ * Strips ITM framing and returns the payload written to itm_port. Sync,
+ * overflow, local and global timestamp and extension packets are skipped, as
+ * are hardware source (DWT) packets. An overflow means records were lost, so the output
+ * is cut short there rather than decoded misaligned.
+ */
+static size_t ParseItm(const uint8_t *data, size_t length, uint8_t *out)
+{
+	
+	size_t count = 0;
+	size_t i = 0;
+	
+	while (i < length)
+	{
+		
+		uint8_t header = data[i++];
+		
+		// sync is at least 47 zero bits followed by a 1, i.e. zeros then 0x80
+		if (header == 0x00)
+		{
+			
+			while (i < length && data[i] == 0x00)
+			{
+				i++;
+			}
+			
+			if (i < length && data[i] == 0x80)
+			{
+				i++;
+			}
+			
+			continue;
+			
+		}
+		
+		if (header == 0x70)
+		{
+			fprintf(stderr, "ITM overflow after %u records, stopping\n", (unsigned)(count / sizeof(trace_record_t)));
+			break;
+		}
+		
+		// timestamp (low nibble 0) and extension (bits 3:2 = 10) packets
+		if ((header & 0x0F) == 0x00 || (header & 0x0B) == 0x08)
+		{
+			
+			if (header & 0x80)
+			{
+				
+				while (i < length && (data[i] & 0x80))
+				{
+					i++;
+				}
+				
+				i++;
+				
+			}
+			
+			continue;
+			
+		}
+		
+		// global timestamps, GTS1 (0x94) and GTS2 (0xB4), payload bytes chained by bit 7
+		if ((header & 0xDF) == 0x94)
+		{
+			
+			while (i < length && (data[i] & 0x80))
+			{
+				i++;
+			}
+			
+			i++;
+			continue;
+			
+		}
+		
+		size_t size = (header & 0x03) == 3 ? 4 : (header & 0x03);
+		
+		if (i + size > length)
+		{
+			break;
+		}
+		
+		if (!(header & 0x04) && (uint32_t)(header >> 3) == itm_port)
+		{
+			memcpy(out + count, data + i, size);
+			count += size;
+		}
+		
+		i += size;
+		
+	}
+	
+	return count;
+	
+}
+
+static void Decode(const uint8_t *data, size_t count)
+{
+	
+	size_t n;
+	for (n = 0; n < count; n++)
+	{
+		
+		trace_record_t record;
+		memcpy(&record, data + n * sizeof(trace_record_t), sizeof(trace_record_t));
+		DecodeRecord(&record);
+		
+	}
+	
+}
+
+static void Event(const char *name, char phase, uint32_t pid, uint32_t tid, uint64_t time, const char *args)
+{
+	
+	printf("%s{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f", first_event ? "" : ",\n", name, phase, pid, tid, time / cycles_per_us);
+	
+	if (phase == 'i')
+	{
+		printf(",\"s\":\"t\"");
+	}
+	
+	if (args)
+	{
+		printf(",\"args\":{%s}", args);
+	}
+	
+	printf("}");
+	first_event = false;
+	
+}
+
+static void NameThread(uint32_t pid, uint32_t tid, const char *name)
+{
+	
+	printf("%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", first_event ? "" : ",\n", pid, tid, name);
+	first_event = false;
+	
+}
+
+static void SeeTask(uint32_t task)
+{
+	
+	if (task >= MAX_THREADS || task == TRACE_NO_TASK || task_seen[task])
+	{
+		return;
+	}
+	
+	char name[32];
+	snprintf(name, sizeof(name), task == 0 ? "idle" : "task %u", task);
+	NameThread(1, task, name);
+	task_seen[task] = true;
+	
+}
+
+static void DecodeRecord(const trace_record_t *record)
+{
+	
+	// the cycle counter is 32 bits, unwrap it assuming less than one wrap
+	// (~89s at 48MHz) between consecutive records
+	uint64_t time = (last_time & ~0xFFFFFFFFULL) | record->time;
+	
+	if (time < last_time)
+	{
+		time += 0x100000000ULL;
+	}
+	
+	last_time = time;
+	
+	char args[64];
+	uint32_t task = record->task;
+	uint32_t exception = record->arg & 0xFF;
+	
+	switch (record->type)
+	{
+		
+		case TRACE_SWITCH:
+			
+			if (running != TRACE_NO_TASK && task_open[running])
+			{
+				Event("run", 'E', 1, running, time, 0);
+				task_open[running] = false;
+			}
+			
+			SeeTask(task);
+			Event("run", 'B', 1, task, time, 0);
+			task_open[task] = true;
+			running = task;
+			break;
+			
+		case TRACE_WAIT:
+			
+			SeeTask(task);
+			Event("wait", 'i', 1, task, time, 0);
+			break;
+			
+		case TRACE_RELEASE:
+			
+			SeeTask(task);
+			
+			if (record->arg & TRACE_FROM_ISR)
+			{
+				snprintf(args, sizeof(args), "\"by_exception\":%u", exception);
+			}
+			else
+			{
+				snprintf(args, sizeof(args), "\"by_task\":%u", record->arg);
+			}
+			
+			Event("release", 'i', 1, task, time, args);
+			break;
+			
+		case TRACE_ISR_ENTER:
+			
+			if (!isr_seen[exception])
+			{
+				
+				char name[32];
+				snprintf(name, sizeof(name), exception == 15 ? "SysTick" : exception >= 16 ? "IRQ %u" : "exception %u", exception >= 16 ? exception - 16 : exception);
+				NameThread(2, exception, name);
+				isr_seen[exception] = true;
+				
+			}
+			
+			Event("isr", 'B', 2, exception, time, 0);
+			isr_depth[exception]++;
+			break;
+			
+		case TRACE_ISR_EXIT:
+			
+			// an exit without its entry was cut off at the start of the capture
+			if (isr_depth[exception])
+			{
+				Event("isr", 'E', 2, exception, time, 0);
+				isr_depth[exception]--;
+			}
+			
+			break;
+			
+		case TRACE_MARK:
+			
+			snprintf(args, sizeof(args), "\"id\":%u", record->arg);
+			Event("mark", 'i', 1, running == TRACE_NO_TASK ? 0 : running, time, args);
+			break;
+			
+		default:
+			
+			fprintf(stderr, "unknown record type %u at cycle %llu\n", record->type, (unsigned long long)time);
+			break;
+			
+	}
+	
+}
\ No newline at end of file
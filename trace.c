@@ -0,0 +1,127 @@
+#include "trace.h"
+
+#include "efm32.h"
+#include "efm32_dbg.h"
+
+#include "dwt.h"
+
+/*
+ * The TPIU registers are not in this CMSIS version either, map the few
+ * needed to run SWO in NRZ (UART) mode.
+ */
+#define TPIU_ACPR 					(*(volatile uint32_t*)0xE0040010)
+#define TPIU_SPPR 					(*(volatile uint32_t*)0xE00400F0)
+#define TPIU_FFCR 					(*(volatile uint32_t*)0xE0040304)
+#define TPIU_SPPR_NRZ 			2
+#define ITM_LAR_KEY 				0xC5ACCE55
+#define ITM_TCR_ATBID_1 			(1 << ITM_TCR_ATBID_Pos)
+
+/* variables */
+trace_ring_t trace_ring; // not static, so the debugger can dump it by name
+static bool trace_swo = false;
+
+/*
+ * Binary trace of scheduler events. Each event is an 8 byte trace_record_t
+ * stamped with the DWT cycle counter. With SWO on, records go out as two
+ * 32-bit writes to ITM stimulus port TRACE_ITM_PORT; otherwise they are kept
+ * in trace_ring, overwriting the oldest, to be dumped with e.g.
+ * "dump binary value trace.bin trace_ring" in gdb. tools/tracedecode.c reads
+ * either form and writes Chrome trace JSON.
+ */
+
+/* functions */
+
+/* call before SCHEDULER_Init, enabling the cycle counter resets it */
+void TRACE_Init(bool swo)
+{
+	
+	DWT_Enable();
+	
+	trace_ring.magic = TRACE_MAGIC;
+	trace_ring.head = 0;
+	trace_ring.size = TRACE_RING_SIZE;
+	
+	trace_swo = swo;
+	
+	if (!swo)
+	{
+		return;
+	}
+	
+	DBG_SWOEnable(TRACE_SWO_LOCATION);
+	
+	TPIU_SPPR = TPIU_SPPR_NRZ;
+	TPIU_ACPR = TRACE_SWO_PRESCALER;
+	TPIU_FFCR = 0x100; // no formatter, ITM data only
+	
+	ITM->LAR = ITM_LAR_KEY;
+	ITM->TER = 0;
+	ITM->TCR = 0;
+	ITM->TPR = 0; // stimulus ports writable from unprivileged code
+	ITM->TCR = ITM_TCR_ATBID_1 | ITM_TCR_SYNCENA_Msk | ITM_TCR_ITMENA_Msk;
+	ITM->TER = (1 << TRACE_ITM_PORT);
+	
+}
+
+/*
+ * Writes one record. Callable from tasks, interrupts and from inside
+ * SCHEDULER_Switch, so PRIMASK is saved and restored rather than going
+ * through INT_Disable/INT_Enable, which would re-enable interrupts there.
+ */
+void TRACE_Record(uint8_t type, uint8_t task, uint16_t arg)
+{
+	
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	
+	uint32_t time = DWT_CycleCount();
+	uint32_t word = type | (task << 8) | (arg << 16);
+	
+	if (trace_swo)
+	{
+		
+		while (ITM->PORT[TRACE_ITM_PORT].u32 == 0);
+		ITM->PORT[TRACE_ITM_PORT].u32 = time;
+		while (ITM->PORT[TRACE_ITM_PORT].u32 == 0);
+		ITM->PORT[TRACE_ITM_PORT].u32 = word;
+		
+	}
+	else
+	{
+		
+		trace_record_t *record = &trace_ring.records[trace_ring.head & (TRACE_RING_SIZE - 1)];
+		
+		record->time = time;
+		record->type = type;
+		record->task = task;
+		record->arg = arg;
+		trace_ring.head++;
+		
+	}
+	
+	__set_PRIMASK(primask);
+	
+}
+
+/* call first thing in an interrupt handler to trace it */
+void TRACE_IsrEnter()
+{
+	
+	TRACE_Record(TRACE_ISR_ENTER, TRACE_NO_TASK, __get_IPSR());
+	
+}
+
+void TRACE_IsrExit()
+{
+	
+	TRACE_Record(TRACE_ISR_EXIT, TRACE_NO_TASK, __get_IPSR());
+	
+}
+
+/* the decoder attributes a marker to the task running at the time */
+void TRACE_Mark(uint16_t id)
+{
+	
+	TRACE_Record(TRACE_MARK, TRACE_NO_TASK, id);
+	
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TRACE_ITM_PORT 		1 // stimulus port the records are written to
+#define TRACE_SWO_LOCATION 	0 // SWO pin location passed to DBG_SWOEnable
+#define TRACE_SWO_PRESCALER 	15 // SWO bit rate = AUXHFRCO / (TRACE_SWO_PRESCALER + 1)
+#define TRACE_RING_SIZE 		512 // records kept in RAM when SWO is off, a power of two
+#define TRACE_MAGIC 			0x54524345 // "TRCE", marks a dump of trace_ring
+#define TRACE_NO_TASK 		0xFF // task field of records not tied to a task
+
+// record types
+#define TRACE_SWITCH 			1 // task switched in, arg = task switched out
+#define TRACE_WAIT 			2 // task blocked
+#define TRACE_RELEASE 		3 // task woken, arg = waking task or 0x8000 | exception number
+#define TRACE_ISR_ENTER 		4 // arg = exception number
+#define TRACE_ISR_EXIT 		5 // arg = exception number
+#define TRACE_MARK 			6 // user marker, arg = marker id
+
+#define TRACE_FROM_ISR 		0x8000
+
+typedef struct
+{
+
+	uint32_t time; // DWT cycle count
+	uint8_t type;
+	uint8_t task;
+	uint16_t arg;
+
+} trace_record_t;
+
+typedef struct
+{
+
+	uint32_t magic;
+	uint32_t head; // records written, free running
+	uint32_t size;
+	trace_record_t records[TRACE_RING_SIZE];
+
+} trace_ring_t;
+
+void TRACE_Init(bool swo);
+void TRACE_Record(uint8_t type, uint8_t task, uint16_t arg);
+void TRACE_IsrEnter();
+void TRACE_IsrExit();
+void TRACE_Mark(uint16_t id);
+
+#endif
\ No newline at end of file
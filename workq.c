@@ -0,0 +1,232 @@
+#include "workq.h"
+
+#include "efm32.h"
+#include "efm32_int.h"
+
+#include "scheduler.h"
+
+#define WORKQ_MASK 			(WORKQ_DEPTH - 1)
+
+typedef struct
+{
+	
+	volatile uint32_t sequence; // position + 1 once filled, position + WORKQ_DEPTH once free again
+	workq_fn_t fn;
+	void *arg;
+	
+} workq_slot_t;
+
+typedef struct
+{
+	
+	volatile uint32_t head; // next position to claim, advanced by producers with LDREX/STREX
+	uint32_t tail; // only written by the worker
+	workq_slot_t slots[WORKQ_DEPTH];
+	
+} workq_ring_t;
+
+/* variables */
+static workq_ring_t rings[WORKQ_LEVELS];
+static volatile uint32_t waiting = 0; // the worker is blocked on workq_event
+static volatile uint32_t dropped = 0;
+SCHEDULER_TASK_DEFINE(workq_task, WORKQ_STACK_SIZE);
+static event_t workq_event;
+
+/* prototypes */
+static void WORKQ_Task();
+static bool WORKQ_Take(workq_ring_t *ring, workq_fn_t *fn, void **arg);
+
+/*
+ * Deferred interrupt work. An ISR posts a function and its argument and
+ * returns; the worker task runs the items later, highest level first and in
+ * posting order within a level. Each level is a bounded ring in which every
+ * slot carries a sequence number: a producer claims a position by moving
+ * head on with LDREX/STREX, fills the slot and then publishes it through the
+ * sequence, so interrupts of any priority can post without masking, and the
+ * worker never reads a slot that is claimed but not yet filled. Work items
+ * may block; the ISRs they were deferred from are not held up either way.
+ */
+
+/* functions */
+bool WORKQ_Init(uint32_t priority)
+{
+	
+	uint32_t level, i;
+	for (level = 0; level < WORKQ_LEVELS; level++)
+	{
+		
+		rings[level].head = 0;
+		rings[level].tail = 0;
+		
+		for (i = 0; i < WORKQ_DEPTH; i++)
+		{
+			rings[level].slots[i].sequence = i;
+		}
+		
+	}
+	
+	waiting = 0;
+	dropped = 0;
+	SCHEDULER_EventInit(&workq_event);
+	
+	return SCHEDULER_TaskInit(&workq_task, WORKQ_Task, priority);
+	
+}
+
+/*
+ * Queues fn(arg) at the given level. Lock-free and safe from any interrupt;
+ * the kernel is only entered to wake the worker when it is blocked. Returns
+ * false, counting a drop, if the level's ring is full.
+ */
+bool WORKQ_Post(uint32_t level, workq_fn_t fn, void *arg)
+{
+	
+	if (level >= WORKQ_LEVELS)
+	{
+		level = WORKQ_LEVELS - 1;
+	}
+	
+	workq_ring_t *ring = &rings[level];
+	workq_slot_t *slot;
+	uint32_t head;
+	
+	while (1)
+	{
+		
+		head = __LDREXW(&ring->head);
+		slot = &ring->slots[head & WORKQ_MASK];
+		
+		int32_t lap = (int32_t)(slot->sequence - head);
+		
+		if (lap == 0)
+		{
+			
+			if (!__STREXW(head + 1, &ring->head))
+			{
+				break;
+			}
+			
+			continue;
+			
+		}
+		
+		__CLREX();
+		
+		// still holds an item from the previous lap
+		if (lap < 0)
+		{
+			
+			INT_Disable();
+			dropped++;
+			INT_Enable();
+			
+			return false;
+			
+		}
+		
+		// a nested interrupt claimed this position meanwhile, head has moved on
+		
+	}
+	
+	slot->fn = fn;
+	slot->arg = arg;
+	__DMB();
+	slot->sequence = head + 1;
+	
+	__DMB();
+	
+	if (waiting)
+	{
+		waiting = 0;
+		SCHEDULER_EventSignal(&workq_event, 1);
+	}
+	
+	return true;
+	
+}
+
+/* items refused because their level was full */
+uint32_t WORKQ_Dropped()
+{
+	
+	return dropped;
+	
+}
+
+static void WORKQ_Task()
+{
+	
+	while (1)
+	{
+		
+		workq_fn_t fn;
+		void *arg;
+		int32_t level;
+		
+		// look from the top again after every item, so urgent work goes next
+		for (level = WORKQ_LEVELS - 1; level >= 0; level--)
+		{
+			
+			if (WORKQ_Take(&rings[level], &fn, &arg))
+			{
+				break;
+			}
+			
+		}
+		
+		if (level >= 0)
+		{
+			fn(arg);
+			continue;
+		}
+		
+		INT_Disable();
+		
+		// a post from here on sees waiting set and wakes us
+		waiting = 1;
+		
+		for (level = 0; level < WORKQ_LEVELS; level++)
+		{
+			
+			if (rings[level].slots[rings[level].tail & WORKQ_MASK].sequence == rings[level].tail + 1)
+			{
+				waiting = 0;
+				break;
+			}
+			
+		}
+		
+		if (waiting)
+		{
+			SCHEDULER_EventWait(&workq_event, 1);
+		}
+		
+		INT_Enable();
+		
+	}
+	
+}
+
+/* worker side, takes the oldest published item of a ring */
+static bool WORKQ_Take(workq_ring_t *ring, workq_fn_t *fn, void **arg)
+{
+	
+	workq_slot_t *slot = &ring->slots[ring->tail & WORKQ_MASK];
+	
+	if (slot->sequence != ring->tail + 1)
+	{
+		return false;
+	}
+	
+	__DMB();
+	*fn = slot->fn;
+	*arg = slot->arg;
+	__DMB();
+	
+	// free for the producer that reaches this slot on the next lap
+	slot->sequence = ring->tail + WORKQ_DEPTH;
+	ring->tail++;
+	
+	return true;
+	
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#ifndef __WORKQ_H__
+#define __WORKQ_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "scheduler.h"
+
+#define WORKQ_LEVELS 			4 // work priorities, WORKQ_LEVELS - 1 runs first
+#define WORKQ_DEPTH 			16 // items per level, a power of two
+#ifdef SCHEDULER_HOSTED
+#define WORKQ_STACK_SIZE 	65536
+#else
+#define WORKQ_STACK_SIZE 	1024 // worker task stack, work items run on it
+#endif
+
+typedef void (*workq_fn_t)(void *arg);
+
+bool WORKQ_Init(uint32_t priority);
+bool WORKQ_Post(uint32_t level, workq_fn_t fn, void *arg);
+uint32_t WORKQ_Dropped();
+
+#endif
\ No newline at end of file